@@ -3,13 +3,48 @@
   start of chapter 4 of Norvig's PAIP.
 
   by Richard Kelley
+
+  Build with:
+
+    g++ -std=c++11 -O2 -pthread gps.cpp -o gps
+
+  Add -mavx2 (or -march=native) to get the 8-wide AVX2 set merges
+  instead of the 4-wide SSE2 ones, -DGPS_STATS to count what the
+  solver does (see SearchStats), and -DGPS_COUNT_ALLOCS to count
+  allocations, which --bench and --check-allocs need. Domain
+  snapshots use POSIX mmap.
+
+  The Makefile does the same with make, and make check builds a copy
+  with both counters compiled in and runs the --check-* self-checks
+  below, failing if any of them finds a mismatch. make bench builds
+  one with just the allocation counter and runs --bench.
 */
 
+#include <cerrno>
+#include <cstdint>
 #include <cstdio>
-#include <list>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <new>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <algorithm>
+#include <bitset>
+#include <chrono>
 #include <functional>
+#include <iterator>
+#include <random>
+#include <type_traits>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /*
   Type aliases introduced by the using keyword are similar to the
@@ -17,26 +52,380 @@
   readability (particularly when working with functions as values), and
   when working with templates.
 
-  The Lisp version of the program uses symbols to represent conditions.
-  We can get away with using std::strings in this case.
+  The Lisp version of the program uses symbols to represent conditions,
+  and gets symbol identity for free: every occurrence of 'car-works is
+  the same object, so member can compare with eql. We recover that
+  property by interning. Each condition name is stored exactly once in
+  a SymbolTable, and the rest of the program passes around a dense
+  32-bit ID. Comparing two Conditions is now comparing two integers,
+  and copying one costs nothing.
+*/
+using Condition = std::uint32_t;
+
+/*
+  Names go in once, when the domain is built, and come back out only
+  when we print something for a human. IDs are handed out in order
+  starting from zero, so they can be used directly as array indices.
+
+  A std::unordered_map<std::string, Condition> would do the job, but
+  it wants a std::string to look anything up, and a domain loader
+  would have to allocate one for every word it reads. Instead, all
+  the names live end to end in one character pool, each followed by a
+  '\0' so name() can hand back a C string, and the lookup table is an
+  open-addressing hash table of IDs. Interning a name that's already
+  there only reads memory.
+*/
+/*
+  The lookup table is a flat array of SymbolSlots, and the functions
+  that search it only need the array and the pool, so a compiled
+  Domain can search a copy of the same table without a SymbolTable.
+  Each slot carries enough to reject a wrong name without looking
+  anywhere else: the top half of its hash, and where its characters
+  are in the pool. A successful lookup touches the slot and the pool
+  and nothing more.
+*/
+struct SymbolSlot {
+  static constexpr Condition empty = ~Condition{0};
+
+  Condition id = empty;
+  std::uint32_t tag = 0;
+  std::uint32_t offset = 0;
+  std::uint32_t length = 0;
+};
+
+constexpr Condition SymbolSlot::empty;
+
+// FNV-1a: simple, and good enough for short identifiers.
+inline std::uint64_t symbol_hash(const char* name, std::size_t length) {
+  std::uint64_t h = 14695981039346656037ull;
+  for (std::size_t i = 0; i < length; ++i) {
+    h = (h ^ static_cast<unsigned char>(name[i])) * 1099511628211ull;
+  }
+  return h ^ (h >> 29);
+}
+
+/*
+  Find the slot holding name, or the empty slot where it would go.
+  n_slots is always a power of two, and the table is never more than
+  half full, so the probe always ends.
+*/
+inline std::size_t find_symbol_slot(const SymbolSlot* slots, std::size_t n_slots, const char* pool,
+                                    const char* name, std::size_t length, std::uint64_t h) {
+  std::size_t mask = n_slots - 1;
+  std::uint32_t tag = static_cast<std::uint32_t>(h >> 32);
+  for (std::size_t i = h & mask;; i = (i + 1) & mask) {
+    const SymbolSlot& slot = slots[i];
+    if (slot.id == SymbolSlot::empty ||
+        (slot.tag == tag && slot.length == length &&
+         std::equal(name, name + length, pool + slot.offset))) {
+      return i;
+    }
+  }
+}
+
+class SymbolTable {
+public:
+  SymbolTable() : slots_(16) { }
+
+  Condition intern(const char* name, std::size_t length) {
+    std::uint64_t h = symbol_hash(name, length);
+    SymbolSlot& slot = slots_[find_symbol_slot(slots_.data(), slots_.size(), pool_.data(), name, length, h)];
+    if (slot.id != SymbolSlot::empty) {
+      return slot.id;
+    }
+    Condition id = static_cast<Condition>(offsets_.size());
+    slot.id = id;
+    slot.tag = static_cast<std::uint32_t>(h >> 32);
+    slot.offset = static_cast<std::uint32_t>(pool_.size());
+    slot.length = static_cast<std::uint32_t>(length);
+    offsets_.push_back(slot.offset);
+    pool_.append(name, length);
+    pool_.push_back('\0');
+    if (2 * offsets_.size() > slots_.size()) {
+      grow();
+    }
+    return id;
+  }
+
+  Condition intern(const std::string& name) { return intern(name.data(), name.size()); }
+
+  bool lookup(const char* name, std::size_t length, Condition& c) const {
+    const SymbolSlot& slot = slots_[find_symbol_slot(slots_.data(), slots_.size(), pool_.data(),
+                                                     name, length, symbol_hash(name, length))];
+    if (slot.id == SymbolSlot::empty) {
+      return false;
+    }
+    c = slot.id;
+    return true;
+  }
+
+  bool lookup(const std::string& name, Condition& c) const {
+    return lookup(name.data(), name.size(), c);
+  }
+
+  const char* name(Condition c) const { return pool_.data() + offsets_[c]; }
+
+  std::size_t size() const { return offsets_.size(); }
+
+  // The raw tables, for compiling a Domain.
+  const std::string& pool() const { return pool_; }
+  const std::vector<std::uint32_t>& offsets() const { return offsets_; }
+  const std::vector<SymbolSlot>& slots() const { return slots_; }
+
+private:
+  void grow() {
+    std::vector<SymbolSlot> bigger(2 * slots_.size());
+    std::size_t mask = bigger.size() - 1;
+    for (const SymbolSlot& slot : slots_) {
+      if (slot.id != SymbolSlot::empty) {
+        std::size_t i = symbol_hash(pool_.data() + slot.offset, slot.length) & mask;
+        while (bigger[i].id != SymbolSlot::empty) {
+          i = (i + 1) & mask;
+        }
+        bigger[i] = slot;
+      }
+    }
+    slots_.swap(bigger);
+  }
+
+  std::string pool_;
+  std::vector<std::uint32_t> offsets_;
+  std::vector<SymbolSlot> slots_;
+};
+
+/*
+  Operators are referred to by their position in the operator table,
+  the same way conditions are referred to by their interned ID.
 */
-using Condition = std::string;
+using OpId = std::uint32_t;
 
+/*
+  An Op's condition lists are short vectors of IDs rather than
+  std::lists, so walking one touches a single contiguous block of
+  memory. Ops are built once, stored once in a Domain's operator table,
+  and from then on are only ever referred to by OpId or by const
+  reference. The constructor takes its arguments by value and moves
+  them into place, so building an Op from temporaries copies nothing.
+*/
 struct Op {
   std::string action;
-  std::list<Condition> preconds;
-  std::list<Condition> add_list;
-  std::list<Condition> del_list;
+  std::vector<Condition> preconds;
+  std::vector<Condition> add_list;
+  std::vector<Condition> del_list;
+
+  Op(std::string _action,
+     std::vector<Condition> _preconds,
+     std::vector<Condition> _add_list,
+     std::vector<Condition> _del_list) :
+    action { std::move(_action) },
+    preconds { std::move(_preconds) },
+    add_list { std::move(_add_list) },
+    del_list { std::move(_del_list) } { }
+
+};
+
+/*
+  A State is the set of conditions that currently hold. Since
+  conditions are dense IDs, a set of them is just a bit vector with
+  one bit per interned condition, packed into 64-bit words. Membership
+  is a single bit probe instead of a walk down a linked list, and the
+  whole-set operations below work a word at a time:
+
+    includes(pre)    is   (state & pre) == pre
+    apply(del, add)  is   state = (state & ~del) | add
+
+  The width is fixed when the State is created, so make States only
+  after every condition of the domain has been interned.
+
+  A State made by a Domain also keeps a Zobrist hash of itself: every
+  condition has a random 64-bit key, and the hash is the XOR of the
+  keys of the conditions that hold. Flipping a bit flips its key in
+  or out of the hash, so every change below, undo included, keeps the
+  hash up to date in O(1) per condition instead of rehashing the
+  whole state. Two equal States made by the same Domain always have
+  the same hash. States used as masks don't have keys, and their
+  hash() is always 0.
+*/
+class State {
+public:
+  using Word = std::uint64_t;
+  static constexpr std::size_t bits_per_word = 64;
+
+  State() = default;
+
+  explicit State(std::size_t n_conditions)
+    : words_((n_conditions + bits_per_word - 1) / bits_per_word, 0) { }
+
+  /*
+    An empty State that hashes with keys, which must have one entry
+    per condition and outlive the State.
+  */
+  State(std::size_t n_conditions, const std::uint64_t* keys)
+    : State(n_conditions) {
+    keys_ = keys;
+  }
+
+  template<typename Container>
+  State(std::size_t n_conditions, const Container& conditions)
+    : State(n_conditions) {
+    for (auto c : conditions) {
+      set(c);
+    }
+  }
+
+  bool test(Condition c) const {
+    return (words_[c / bits_per_word] >> (c % bits_per_word)) & 1;
+  }
+
+  /*
+    Make this the set of exactly the given conditions, reusing the
+    words we already have rather than allocating new ones.
+  */
+  template<typename Container>
+  void assign(const Container& conditions) {
+    std::fill(std::begin(words_), std::end(words_), 0);
+    hash_ = 0;
+    for (auto c : conditions) {
+      set(c);
+    }
+  }
+
+  void set(Condition c) {
+    if (!test(c)) {
+      flip(c);
+    }
+  }
+
+  void reset(Condition c) {
+    if (test(c)) {
+      flip(c);
+    }
+  }
+
+  void flip(Condition c) {
+    words_[c / bits_per_word] ^= mask(c);
+    if (keys_ != nullptr) {
+      hash_ ^= keys_[c];
+    }
+  }
+
+  bool includes(const State& pre) const {
+    for (std::size_t i = 0; i < words_.size(); ++i) {
+      if ((words_[i] & pre.words_[i]) != pre.words_[i]) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void apply(const State& del, const State& add) {
+    for (std::size_t i = 0; i < words_.size(); ++i) {
+      Word old = words_[i];
+      words_[i] = (old & ~del.words_[i]) | add.words_[i];
+      rehash_word(i, old ^ words_[i]);
+    }
+  }
+
+  /*
+    Same thing, but for effects given as lists of conditions. An Op
+    usually touches a handful of conditions, so this is cheaper than
+    building two full-width masks for it.
+  */
+  template<typename Container>
+  void apply(const Container& del, const Container& add) {
+    for (auto c : del) {
+      reset(c);
+    }
+    for (auto c : add) {
+      set(c);
+    }
+  }
+
+  /*
+    Same again, but append every condition whose bit actually changed
+    to trail. Applying an op that deletes something already false, or
+    adds something already true, leaves nothing on the trail for it.
+  */
+  template<typename Container>
+  void apply(const Container& del, const Container& add, std::vector<Condition>& trail) {
+    for (auto c : del) {
+      if (test(c)) {
+        reset(c);
+        trail.push_back(c);
+      }
+    }
+    for (auto c : add) {
+      if (!test(c)) {
+        set(c);
+        trail.push_back(c);
+      }
+    }
+  }
+
+  /*
+    Take back every change on the trail after checkpoint, newest
+    first. Each entry is a bit that was flipped, so flipping it again
+    restores it, and the cost is the number of changes, not the width
+    of the state.
+  */
+  void undo(std::vector<Condition>& trail, std::size_t checkpoint) {
+    while (trail.size() > checkpoint) {
+      flip(trail.back());
+      trail.pop_back();
+    }
+  }
+
+  std::size_t count() const {
+    std::size_t n = 0;
+    for (auto w : words_) {
+      n += std::bitset<bits_per_word>(w).count();
+    }
+    return n;
+  }
+
+  /*
+    The raw words, for code that stores many States side by side
+    instead of as separate objects.
+  */
+  std::size_t n_words() const { return words_.size(); }
+  const Word* words() const { return words_.data(); }
 
-  Op(std::string _action, 
-     std::list<Condition> _preconds,
-     std::list<Condition> _add_list,
-     std::list<Condition> _del_list) : 
-    action { _action },
-    preconds { _preconds },
-    add_list { _add_list },
-    del_list { _del_list } { }
+  void assign_words(const Word* words) {
+    std::copy(words, words + words_.size(), std::begin(words_));
+    hash_ = 0;
+    for (std::size_t i = 0; i < words_.size(); ++i) {
+      rehash_word(i, words_[i]);
+    }
+  }
+
+  // For callers that stored the hash along with the words.
+  void assign_words(const Word* words, std::uint64_t hash) {
+    std::copy(words, words + words_.size(), std::begin(words_));
+    hash_ = keys_ != nullptr ? hash : 0;
+  }
+
+  std::uint64_t hash() const { return hash_; }
+
+  bool operator==(const State& other) const { return words_ == other.words_; }
+  bool operator!=(const State& other) const { return words_ != other.words_; }
+
+private:
+  static Word mask(Condition c) { return Word{1} << (c % bits_per_word); }
+
+  // Flip the keys of the conditions whose bits are set in changed.
+  void rehash_word(std::size_t i, Word changed) {
+    if (keys_ == nullptr) {
+      return;
+    }
+    while (changed != 0) {
+      hash_ ^= keys_[i * bits_per_word + __builtin_ctzll(changed)];
+      changed &= changed - 1;
+    }
+  }
 
+  std::vector<Word> words_;
+  const std::uint64_t* keys_ = nullptr;
+  std::uint64_t hash_ = 0;
 };
 
 /*
@@ -61,6 +450,38 @@ std::function<bool(T)> complement(std::function<bool(T)> fn) {
   return [fn](T x) { return !fn(x); };
 }
 
+/*
+  The price of std::function is that it hides the type of what it
+  holds. Every call goes through a pointer, so the compiler can't
+  inline the function you passed in, and storing a large closure may
+  allocate.
+
+  This version of complement works on any callable and keeps its
+  type. C++11 doesn't let a function return a lambda unless it's
+  wrapped in something like std::function, so we write the closure
+  out by hand: Complement is exactly the object the lambda above would
+  be, with fn as its captured variable. The variadic operator() means
+  it works for predicates of any number of arguments, just like
+  the &rest args in the Lisp compl.
+
+  When you call complement with a std::function, the first version is
+  more specialized, so it still gets picked.
+*/
+template<typename Fn>
+struct Complement {
+  Fn fn;
+
+  template<typename... Args>
+  bool operator()(Args&&... args) const {
+    return !fn(std::forward<Args>(args)...);
+  }
+};
+
+template<typename Fn>
+Complement<typename std::decay<Fn>::type> complement(Fn&& fn) {
+  return { std::forward<Fn>(fn) };
+}
+
 /*
   An Op is appropriate for a goal if the goal is in the Op's add_list.
 
@@ -75,8 +496,12 @@ std::function<bool(T)> complement(std::function<bool(T)> fn) {
   we're not using std::end as a member function. This is new, and
   means that we can do things like get iterators into arrays if we
   need to.
+
+  Notice that op is passed by const reference. Passing an Op by value
+  would copy its name and all three of its condition lists, just to
+  look at one of them.
  */
-bool appropriate_p(Condition goal, Op op) {
+bool appropriate_p(Condition goal, const Op& op) {
   return std::end(op.add_list) != std::find(std::begin(op.add_list), std::end(op.add_list), goal);
 }
 
@@ -87,34 +512,54 @@ bool appropriate_p(Condition goal, Op op) {
   Is there a more concise way to write this function? Is there a more
   concise way to do it _without modifying any of the inputs_?
 
-  Also, is it odd that I'm returning a std::list by value? In C++11,
+  Also, is it odd that I'm returning a std::vector by value? In C++11,
   this is very defensible. In C++98, it happens that this is often
   defensible. It would be wise to understand why it might not be a
   good idea, and why it could be.
+
+  What we return are the positions of the matching operators, not
+  copies of them. The operators themselves stay where they are.
 */
-std::list<Op> find_all(Condition goal, std::list<Op> ops, std::function<bool(Condition, Op)> pred) {
-  std::list<Op> res{};
-  for (const auto& elt : ops) {
-    if (pred(goal, elt)) {
-      res.push_back(elt);
+std::vector<OpId> find_all(Condition goal, const std::vector<Op>& ops,
+                           std::function<bool(Condition, const Op&)> pred) {
+  std::vector<OpId> res{};
+  for (OpId i = 0; i < ops.size(); ++i) {
+    if (pred(goal, ops[i])) {
+      res.push_back(i);
+    }
+  }
+  return res;
+}
+
+/*
+  The same function with the predicate's type as a template parameter.
+  Each predicate gets its own copy of find_all, and the call to pred
+  can be inlined into the loop. Passing a plain function like
+  appropriate_p picks this version, because it matches without first
+  converting to a std::function.
+*/
+template<typename Pred>
+std::vector<OpId> find_all(Condition goal, const std::vector<Op>& ops, Pred pred) {
+  std::vector<OpId> res{};
+  for (OpId i = 0; i < ops.size(); ++i) {
+    if (pred(goal, ops[i])) {
+      res.push_back(i);
     }
   }
   return res;
 }
 
-std::list<Condition> current_state;
-std::list<Op> current_operations;
 
 /*
   The next two functions could be written in a much more general
   way. They should work with any container whose elements can be
   compared for equality...
 
-  Again, I'm returning std::list objects. What's wrong (or not wrong)
-  with this?
+  Again, I'm returning std::vector objects. What's wrong (or not wrong)
+  with this? At least the arguments are no longer copied on the way in.
 */
-std::list<Condition> set_diff(std::list<Condition> set1, std::list<Condition> set2) {
-  std::list<Condition> res{};
+std::vector<Condition> set_diff(const std::vector<Condition>& set1, const std::vector<Condition>& set2) {
+  std::vector<Condition> res{};
   auto ending = std::end(set2);
   for(const auto& elt : set1) {
     if (std::find(std::begin(set2), std::end(set2), elt) == ending) {
@@ -124,16 +569,16 @@ std::list<Condition> set_diff(std::list<Condition> set1, std::list<Condition> se
   return res;
 }
 
-std::list<Condition> set_union(std::list<Condition> set1, std::list<Condition> set2) {
-  std::list<Condition> res{};
+std::vector<Condition> set_union(const std::vector<Condition>& set1, const std::vector<Condition>& set2) {
+  std::vector<Condition> res{};
 
   for (const auto& elt : set1) {
     res.push_back(elt);
   }
 
-  auto ending = std::end(set2);
+  auto ending = std::end(set1);
   for (const auto& elt : set2) {
-    if (std::find(std::begin(set2), std::end(set2), elt) == ending) {
+    if (std::find(std::begin(set1), std::end(set1), elt) == ending) {
       res.push_back(elt);
     }
   }
@@ -141,97 +586,4911 @@ std::list<Condition> set_union(std::list<Condition> set1, std::list<Condition> s
 }
 
 /*
-  The functions apply_op and achieve call each other, so one of them
-  has to be declared before the other.
+  Both functions above are O(n*m): for every element of one set they
+  search the whole of the other. If we keep our sets sorted, we can do
+  better. Walk the two sets side by side, like the merge step of merge
+  sort, and each comparison lets us step past at least one element,
+  so difference and union take O(n + m).
 
-  The function std::all_of returns true if its third argument, a
-  predicate, returns true for all elements in the container.
+  A SortedSet is a std::vector of Conditions kept sorted and free of
+  duplicates. It's the right tool for sparse sets, where a State with
+  one bit for every condition in the domain would be mostly zeros.
 */
-bool achieve(Condition goal);
-bool apply_op(Op op) {
-  if (std::all_of(std::begin(op.preconds), std::end(op.preconds), achieve)) {
-    std::printf("Executing operation: %s.\n", op.action.c_str());
-    current_state = set_diff(current_state, op.del_list);
-    current_state = set_union(current_state, op.add_list);
-    return true;
-  } else {
-    return false;
+class SortedSet {
+public:
+  SortedSet() = default;
+
+  template<typename Container>
+  explicit SortedSet(const Container& conditions)
+    : ids_(std::begin(conditions), std::end(conditions)) {
+    std::sort(std::begin(ids_), std::end(ids_));
+    ids_.erase(std::unique(std::begin(ids_), std::end(ids_)), std::end(ids_));
+  }
+
+  bool contains(Condition c) const {
+    return std::binary_search(std::begin(ids_), std::end(ids_), c);
+  }
+
+  std::size_t size() const { return ids_.size(); }
+  bool empty() const { return ids_.empty(); }
+  const Condition* data() const { return ids_.data(); }
+  std::vector<Condition>::const_iterator begin() const { return std::begin(ids_); }
+  std::vector<Condition>::const_iterator end() const { return std::end(ids_); }
+
+  bool operator==(const SortedSet& other) const { return ids_ == other.ids_; }
+  bool operator!=(const SortedSet& other) const { return ids_ != other.ids_; }
+
+  /*
+    The set operations write into a SortedSet the caller owns, so a
+    result set that is reused never has to reallocate once it's big
+    enough. They go through these two so they can fill ids_ directly.
+  */
+  std::vector<Condition>& storage() { return ids_; }
+
+private:
+  std::vector<Condition> ids_;
+};
+
+/*
+  The scalar merges. In set_diff_scalar, an element of a is kept when
+  the walk through b steps past it without finding it; set_union_scalar
+  is std::set_union, which does the same walk and keeps everything.
+*/
+inline void set_diff_scalar(const Condition* a, std::size_t na,
+                            const Condition* b, std::size_t nb,
+                            std::vector<Condition>& out) {
+  std::size_t i = 0, j = 0;
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      out.push_back(a[i++]);
+    } else {
+      j += 1;
+      i += (a[i] == b[j - 1]);
+    }
   }
+  out.insert(std::end(out), a + i, a + na);
+}
+
+inline void set_diff_scalar(const SortedSet& a, const SortedSet& b, SortedSet& out) {
+  out.storage().clear();
+  set_diff_scalar(a.data(), a.size(), b.data(), b.size(), out.storage());
+}
+
+inline void set_union_scalar(const SortedSet& a, const SortedSet& b, SortedSet& out) {
+  out.storage().clear();
+  std::set_union(std::begin(a), std::end(a), std::begin(b), std::end(b),
+                 std::back_inserter(out.storage()));
 }
 
 /*
-  The function std::any_of returns true if its third argument, a
-  predicate, returns true on at least one of the elements in the
-  container.
+  The vectorized difference works on blocks of W elements at a time
+  (4 with SSE2, 8 with AVX2). Comparing a block of a with a block of b
+  for every possible match is W rotations of the b block and W vector
+  compares, which gives a bit mask of the a elements that appear
+  anywhere in the b block. Then we step past whichever block has the
+  smaller last element, exactly as the scalar merge steps past the
+  smaller element. When an a block is finished, the elements whose bit
+  never got set are the ones that aren't in b.
+
+  Whatever is left over when either set has fewer than W elements to
+  go is finished off by the scalar merge. Only the first a block might
+  already have some matches recorded, so those are skipped first.
 */
-bool achieve(Condition goal) {
-  bool left = std::end(current_state) != std::find(std::begin(current_state), std::end(current_state), goal);
-  bool right = false;
-  auto candidates = find_all(goal, current_operations, appropriate_p);
-  if (std::any_of(std::begin(candidates), std::end(candidates), apply_op)) {
-    right = true;
+#if defined(__AVX2__)
+
+#include <immintrin.h>
+
+constexpr std::size_t simd_width = 8;
+
+inline unsigned block_matches(const Condition* a, const Condition* b) {
+  __m256i va = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a));
+  __m256i vb = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b));
+  __m256i rotate = _mm256_setr_epi32(1, 2, 3, 4, 5, 6, 7, 0);
+  __m256i eq = _mm256_cmpeq_epi32(va, vb);
+  for (int r = 1; r < 8; ++r) {
+    vb = _mm256_permutevar8x32_epi32(vb, rotate);
+    eq = _mm256_or_si256(eq, _mm256_cmpeq_epi32(va, vb));
   }
-  return left || right;
+  return static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(eq)));
 }
 
-void GPS(std::list<Condition> state, std::list<Condition> goals, std::list<Op> ops) {
-  if (std::all_of(std::begin(goals), std::end(goals), achieve)) {
-    std::printf("SOLVED.\n");
-  } else {
-    std::printf("FAILED.\n");
+#elif defined(__SSE2__)
+
+#include <emmintrin.h>
+
+constexpr std::size_t simd_width = 4;
+
+inline unsigned block_matches(const Condition* a, const Condition* b) {
+  __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a));
+  __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b));
+  __m128i eq = _mm_cmpeq_epi32(va, vb);
+  eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(0, 3, 2, 1))));
+  eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(1, 0, 3, 2))));
+  eq = _mm_or_si128(eq, _mm_cmpeq_epi32(va, _mm_shuffle_epi32(vb, _MM_SHUFFLE(2, 1, 0, 3))));
+  return static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(eq)));
+}
+
+#endif
+
+#if defined(__AVX2__) || defined(__SSE2__)
+
+constexpr bool have_simd_sets = true;
+
+inline void set_diff_simd(const Condition* a, std::size_t na,
+                          const Condition* b, std::size_t nb,
+                          std::vector<Condition>& out) {
+  const std::size_t W = simd_width;
+  std::size_t i = 0, j = 0;
+  unsigned found = 0;
+  while (i + W <= na && j + W <= nb) {
+    found |= block_matches(a + i, b + j);
+    Condition a_last = a[i + W - 1];
+    Condition b_last = b[j + W - 1];
+    if (a_last <= b_last) {
+      for (std::size_t k = 0; k < W; ++k) {
+        if (!((found >> k) & 1)) {
+          out.push_back(a[i + k]);
+        }
+      }
+      found = 0;
+      i += W;
+      j += (a_last == b_last) ? W : 0;
+    } else {
+      j += W;
+    }
+  }
+
+  for (std::size_t k = 0; found != 0 && k < W && i < na; ++k, ++i) {
+    if (!((found >> k) & 1)) {
+      while (j < nb && b[j] < a[i]) {
+        ++j;
+      }
+      if (j == nb || b[j] != a[i]) {
+        out.push_back(a[i]);
+      }
+    }
   }
+  set_diff_scalar(a + i, na - i, b + j, nb - j, out);
 }
 
-int main(int argc, char **argv) {
-  // here's how complement works, even though we don't end up using it above.
-  std::function<bool(int)> even_p = [](int n) { return (n % 2 == 0); };
-  std::function<bool(int)> odd_p = complement(even_p);
-  std::printf("2 is even: %d\n", !odd_p(2));
+#else
 
+constexpr bool have_simd_sets = false;
+constexpr std::size_t simd_width = 1;
 
-  // Here's the GPS code:
+inline void set_diff_simd(const Condition* a, std::size_t na,
+                          const Condition* b, std::size_t nb,
+                          std::vector<Condition>& out) {
+  set_diff_scalar(a, na, b, nb, out);
+}
 
-  /*
-    The definitions below use the "uniform initialization"
-    syntax. Except when dealing with a few std::initializer_list
-    corner cases, this syntax should be preferred.
-  */
-  Condition son_at_home{"son-at-home"};
-  Condition car_works{"car-works"};
-  Condition son_at_school{"son-at-school"};
-  Condition car_needs_battery{"car-needs-battery"};
-  Condition shop_knows_problem{"shop-knows-problem"};
-  Condition shop_has_money{"shop-has-money"};
-  Condition know_phone_number{"know-phone-number"};
-  Condition in_communication_with_shop{"in-communication-with-shop"};
-  Condition have_phone_book{"have-phone-book"};
-  Condition have_money{"have-money"};
+#endif
 
-  /*
-    Uncomment one of these four lines to test the GPS function.
+/*
+  set_diff for SortedSets uses the vector unit when there is one.
 
-    We're using "uniform initialization" syntax to assign values to
-    variables of type std::list<Condition>. The utility of this
-    approach over that of C++98 should be obvious.
-  */
-  current_state = {son_at_home, car_needs_battery, have_money, have_phone_book};
-  //current_state = {son_at_home, car_works};
-  //current_state = {son_at_home};
-  //current_state = {son_at_home, car_needs_battery, have_money};
+  A vectorized union can be built the same way, as a U (b - a): the
+  vectorized difference finds what b has that a lacks, and a merge of
+  two disjoint sets puts them in order. That's two passes instead of
+  one, and on the machines we've measured it loses to the plain merge
+  in std::set_union, so set_union uses the scalar merge and
+  set_union_simd is kept for --bench-sets to keep an eye on. The
+  scratch set holds b - a; pass in the same one every time to avoid
+  allocating it.
+*/
+inline void set_diff(const SortedSet& a, const SortedSet& b, SortedSet& out) {
+  out.storage().clear();
+  set_diff_simd(a.data(), a.size(), b.data(), b.size(), out.storage());
+}
+
+inline void set_union(const SortedSet& a, const SortedSet& b, SortedSet& out) {
+  set_union_scalar(a, b, out);
+}
+
+inline void set_union_simd(const SortedSet& a, const SortedSet& b, SortedSet& out, SortedSet& scratch) {
+  set_diff(b, a, scratch);
+  out.storage().clear();
+  std::merge(std::begin(a), std::end(a), std::begin(scratch), std::end(scratch),
+             std::back_inserter(out.storage()));
+}
+
+inline SortedSet set_diff(const SortedSet& a, const SortedSet& b) {
+  SortedSet out;
+  set_diff(a, b, out);
+  return out;
+}
+
+inline SortedSet set_union(const SortedSet& a, const SortedSet& b) {
+  SortedSet out;
+  set_union(a, b, out);
+  return out;
+}
+
+/*
+  A Span is a read-only view of a contiguous run of elements that
+  somebody else owns. It has begin() and end(), so it works with the
+  range-based for loop and the <algorithm> functions, but making one
+  never copies or allocates anything.
+*/
+template<typename T>
+class Span {
+public:
+  Span() = default;
+  Span(const T* first, const T* last) : first_ { first }, last_ { last } { }
+
+  const T* begin() const { return first_; }
+  const T* end() const { return last_; }
+  std::size_t size() const { return static_cast<std::size_t>(last_ - first_); }
+  bool empty() const { return first_ == last_; }
+  const T& operator[](std::size_t i) const { return first_[i]; }
+
+private:
+  const T* first_ = nullptr;
+  const T* last_ = nullptr;
+};
+
+/*
+  find_all answers "which operators add this goal?" by looking at
+  every operator, every time. The answer only depends on the operator
+  table, so we can work it out once for every condition and store it.
+
+  The index is laid out in compressed sparse row (CSR) form: ops
+  holds the IDs of all the adders of condition 0, then all the adders
+  of condition 1, and so on, and the adders of condition c live in
+  ops[offsets[c]] up to ops[offsets[c + 1]]. It's built with two
+  passes over the operators, one to count and one to fill. Within a
+  span, operators keep their table order, so candidates are tried in
+  exactly the order find_all would have returned them.
+
+  A GoalIndex only looks at the two arrays; they belong to the Domain
+  it's part of. The same layout indexes the other way round too: a
+  Domain also keeps a GoalIndex built from the preconditions, which
+  says which operators consume each condition.
+*/
+class GoalIndex {
+public:
+  GoalIndex() = default;
+  GoalIndex(Span<std::uint32_t> offsets, Span<OpId> ops)
+    : offsets_ { offsets }, ops_ { ops } { }
+
+  Span<OpId> candidates(Condition goal) const {
+    if (goal + 1 >= offsets_.size()) {
+      return {};
+    }
+    return { ops_.begin() + offsets_[goal], ops_.begin() + offsets_[goal + 1] };
+  }
 
   /*
-    Uniform initialization and std::initializer_list show up again:
+    First pass: the offsets array for ops, with n_conditions + 1
+    entries. Its last entry is the number of OpIds the index holds.
+    An op that lists the same condition twice is only counted once.
   */
-  current_operations = {
-    Op("drive-son-to-school", {son_at_home, car_works}, {son_at_school}, {son_at_home}),
-    Op("shop-installs-battery", {car_needs_battery, shop_knows_problem, shop_has_money}, {car_works}, {}),
-    Op("tell-shop-problem", {in_communication_with_shop}, {shop_knows_problem}, {}),
-    Op("telephone-shop", {know_phone_number}, {in_communication_with_shop}, {}),
-    Op("look-up-number", {have_phone_book}, {know_phone_number}, {}),
-    Op("give-shop-money", {have_money}, {shop_has_money}, {have_money})
-  };
+  static std::vector<std::uint32_t> count(std::size_t n_conditions, const std::vector<Op>& ops,
+                                          std::vector<Condition> Op::* list = &Op::add_list) {
+    std::vector<std::uint32_t> offsets(n_conditions + 1, 0);
+    std::vector<OpId> last(n_conditions, static_cast<OpId>(ops.size()));
+    for (OpId op = 0; op < ops.size(); ++op) {
+      for (auto c : ops[op].*list) {
+        if (last[c] != op) {
+          last[c] = op;
+          ++offsets[c + 1];
+        }
+      }
+    }
+    for (std::size_t c = 0; c < n_conditions; ++c) {
+      offsets[c + 1] += offsets[c];
+    }
+    return offsets;
+  }
+
+  // Second pass: write the OpIds into the space count() asked for.
+  static void fill(const std::vector<Op>& ops, const std::vector<std::uint32_t>& offsets, OpId* out,
+                   std::vector<Condition> Op::* list = &Op::add_list) {
+    std::size_t n_conditions = offsets.size() - 1;
+    std::vector<std::uint32_t> next(std::begin(offsets), std::end(offsets) - 1);
+    std::vector<OpId> last(n_conditions, static_cast<OpId>(ops.size()));
+    for (OpId op = 0; op < ops.size(); ++op) {
+      for (auto c : ops[op].*list) {
+        if (last[c] != op) {
+          last[c] = op;
+          out[next[c]++] = op;
+        }
+      }
+    }
+  }
+
+private:
+  Span<std::uint32_t> offsets_;
+  Span<OpId> ops_;
+};
+
+/*
+  A read-only memory mapping of a whole file. The mapping goes away
+  with the object.
+*/
+class MappedFile {
+public:
+  MappedFile() = default;
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile() {
+    if (data_ != nullptr) {
+      ::munmap(const_cast<char*>(data_), size_);
+    }
+  }
 
-  GPS(current_state, {son_at_school}, current_operations);
+  bool open(const char* path) {
+    int fd = ::open(path, O_RDONLY);
+    if (fd < 0) {
+      std::fprintf(stderr, "%s: can't open\n", path);
+      return false;
+    }
+    struct stat info;
+    bool ok = ::fstat(fd, &info) == 0 && info.st_size > 0;
+    if (ok) {
+      void* p = ::mmap(nullptr, static_cast<std::size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+      ok = p != MAP_FAILED;
+      if (ok) {
+        data_ = static_cast<const char*>(p);
+        size_ = static_cast<std::size_t>(info.st_size);
+      }
+    }
+    ::close(fd);
+    if (!ok) {
+      std::fprintf(stderr, "%s: can't map\n", path);
+    }
+    return ok;
+  }
+
+  const char* data() const { return data_; }
+  std::size_t size() const { return size_; }
+
+private:
+  const char* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+/*
+  One kind of condition list, say the preconditions, for every
+  operator of a compiled Domain, in the same CSR form as the
+  GoalIndex: the lists are stored end to end in conds, in operator
+  order, and the list of op is conds[offsets[op], offsets[op + 1]).
+
+  A Domain keeps one of these for each of its preconditions, add
+  lists and delete lists, so the operator table is a struct of
+  arrays. Code that looks at one kind of list for every operator,
+  like building an index of which ops need which condition, walks a
+  single array from one end to the other and never touches the
+  others.
+*/
+class ConditionLists {
+public:
+  ConditionLists() = default;
+  ConditionLists(Span<std::uint32_t> offsets, Span<Condition> conds)
+    : offsets_ { offsets },
+      conds_ { conds } { }
+
+  Span<Condition> operator[](OpId op) const {
+    return { conds_.begin() + offsets_[op], conds_.begin() + offsets_[op + 1] };
+  }
+
+  Span<std::uint32_t> offsets() const { return offsets_; }
+  Span<Condition> all() const { return conds_; }
+
+  // Lay out one list per op, as selected by member, at offsets and conds.
+  static void fill(const std::vector<Op>& ops, std::vector<Condition> Op::* member,
+                   std::uint32_t* offsets, Condition* conds) {
+    offsets[0] = 0;
+    for (std::size_t i = 0; i < ops.size(); ++i) {
+      const auto& list = ops[i].*member;
+      conds = std::copy(std::begin(list), std::end(list), conds);
+      offsets[i + 1] = offsets[i] + static_cast<std::uint32_t>(list.size());
+    }
+  }
+
+private:
+  Span<std::uint32_t> offsets_;
+  Span<Condition> conds_;
+};
+
+/*
+  Forward search needs every operator that is applicable in a state,
+  and the obvious way to find them is to test every precondition of
+  every operator. A SuccessorGenerator is a decision tree over the
+  conditions, after the one in Fast Downward, that gets the same
+  answer while looking at far fewer of them.
+
+  Each node tests one condition. The ops below its on_true child all
+  need that condition; the ops along its otherwise chain don't care
+  about it, so that branch is taken whatever the state. A node also
+  lists the ops whose preconditions have all been tested by the time
+  the walk gets there, and those are applicable. The walk therefore
+  only goes into subtrees whose conditions hold, and what it costs is
+  about the number of applicable ops plus the length of the otherwise
+  chains it follows.
+
+  Each op's preconditions are tested most common first, so ops that
+  share a common precondition share the node that tests it and the
+  chains near the root stay short. Nodes are numbered in the order
+  the builder creates them, and each node's ops are appended as it is
+  created, so the ops of node n are ops[nodes[n].first_op] up to
+  ops[nodes[n + 1].first_op], with one extra node at the end to close
+  the last range. Node 0 is the root, unless there are no ops at all.
+*/
+struct SuccessorNode {
+  std::uint32_t first_op;
+  Condition condition;
+  std::uint32_t on_true;
+  std::uint32_t otherwise;
+};
+
+class SuccessorGenerator {
+public:
+  static constexpr std::uint32_t none = ~std::uint32_t{0};
+
+  SuccessorGenerator() = default;
+  SuccessorGenerator(Span<SuccessorNode> nodes, Span<OpId> ops)
+    : nodes_ { nodes },
+      ops_ { ops } { }
+
+  /*
+    Set out to the ops applicable in state, in no particular order.
+    stack is scratch space for the on_true branches still to visit;
+    both vectors keep their capacity, so a warm caller doesn't
+    allocate.
+  */
+  void applicable(const State& state, std::vector<OpId>& out,
+                  std::vector<std::uint32_t>& stack) const {
+    out.clear();
+    stack.clear();
+    if (nodes_.size() > 1) {
+      stack.push_back(0);
+    }
+    while (!stack.empty()) {
+      std::uint32_t n = stack.back();
+      stack.pop_back();
+      for (; n != none; n = nodes_[n].otherwise) {
+        const SuccessorNode& node = nodes_[n];
+        for (std::uint32_t i = node.first_op; i < nodes_[n + 1].first_op; ++i) {
+          out.push_back(ops_[i]);
+        }
+        if (node.on_true != none && state.test(node.condition)) {
+          stack.push_back(node.on_true);
+        }
+      }
+    }
+  }
+
+  Span<SuccessorNode> nodes() const { return nodes_; }
+  Span<OpId> ops() const { return ops_; }
+
+  static void build(std::size_t n_conditions, const ConditionLists& preconds,
+                    std::vector<SuccessorNode>& nodes, std::vector<OpId>& node_ops) {
+    Builder builder { nodes, node_ops, {}, {}, {}, {}, {} };
+    builder.run(n_conditions, preconds);
+  }
+
+private:
+  /*
+    The builder works on ranks rather than conditions: a condition's
+    rank is its place in the order the tests are made in, most common
+    first, so ordering tests is comparing numbers. Every op's tests sit
+    in one array, at the same offsets as its preconditions, with
+    n_tests[op] of them left once duplicates are gone.
+  */
+  struct Builder {
+    std::vector<SuccessorNode>& nodes;
+    std::vector<OpId>& ops;
+    std::vector<Condition> by_rank;
+    std::vector<std::uint32_t> tests;
+    Span<std::uint32_t> offsets;
+    std::vector<std::uint32_t> n_tests;
+    std::vector<std::uint64_t> order;
+
+    void run(std::size_t n_conditions, const ConditionLists& preconds) {
+      offsets = preconds.offsets();
+      std::size_t n_ops = offsets.size() - 1;
+      std::vector<std::uint32_t> uses(n_conditions, 0);
+      for (auto c : preconds.all()) {
+        ++uses[c];
+      }
+      by_rank.resize(n_conditions);
+      for (Condition c = 0; c < n_conditions; ++c) {
+        by_rank[c] = c;
+      }
+      std::sort(std::begin(by_rank), std::end(by_rank), [&](Condition a, Condition b) {
+        return uses[a] != uses[b] ? uses[a] > uses[b] : a < b;
+      });
+      std::vector<std::uint32_t> rank(n_conditions);
+      for (std::uint32_t r = 0; r < n_conditions; ++r) {
+        rank[by_rank[r]] = r;
+      }
+      tests.resize(preconds.all().size());
+      n_tests.resize(n_ops);
+      order.resize(n_ops);
+      for (OpId op = 0; op < n_ops; ++op) {
+        std::uint32_t* first = tests.data() + offsets[op];
+        std::uint32_t* last = first;
+        for (auto c : preconds[op]) {
+          *last++ = rank[c];
+        }
+        std::sort(first, last);
+        n_tests[op] = static_cast<std::uint32_t>(std::unique(first, last) - first);
+        order[op] = op;
+      }
+      nodes.clear();
+      ops.clear();
+      build(0, order.size(), 0);
+      nodes.push_back({ static_cast<std::uint32_t>(ops.size()), 0, none, none });
+    }
+
+    /*
+      order[lo, hi) holds ops that all share their first depth tests,
+      in the low 32 bits. Sorting them by their next test, with 0 for
+      none left and rank + 1 otherwise, in the high bits, brings the
+      ones with no more tests to the front, and they are applicable
+      here; the rest come in runs, one per distinct next test, and
+      each run becomes a node of the chain. Ties go to the lower OpId.
+      Recursion only goes one test deeper at a time, so it's as deep
+      as the longest precondition list.
+    */
+    std::uint32_t build(std::size_t lo, std::size_t hi, std::size_t depth) {
+      for (std::size_t i = lo; i < hi; ++i) {
+        auto op = static_cast<OpId>(order[i]);
+        std::uint64_t next = depth < n_tests[op] ? tests[offsets[op] + depth] + std::uint64_t{1} : 0;
+        order[i] = next << 32 | op;
+      }
+      std::sort(std::begin(order) + lo, std::begin(order) + hi);
+      std::uint32_t head = none;
+      std::uint32_t previous = none;
+      while (lo < hi) {
+        auto n = static_cast<std::uint32_t>(nodes.size());
+        nodes.push_back({ static_cast<std::uint32_t>(ops.size()), 0, none, none });
+        (previous == none ? head : nodes[previous].otherwise) = n;
+        previous = n;
+        for (; lo < hi && order[lo] >> 32 == 0; ++lo) {
+          ops.push_back(static_cast<OpId>(order[lo]));
+        }
+        if (lo == hi) {
+          break;
+        }
+        std::uint64_t next = order[lo] >> 32;
+        std::size_t mid = lo;
+        while (mid < hi && order[mid] >> 32 == next) {
+          ++mid;
+        }
+        nodes[n].condition = by_rank[next - 1];
+        std::uint32_t on_true = build(lo, mid, depth + 1);
+        nodes[n].on_true = on_true;
+        lo = mid;
+      }
+      return head;
+    }
+  };
+
+  Span<SuccessorNode> nodes_;
+  Span<OpId> ops_;
+};
+
+constexpr std::uint32_t SuccessorGenerator::none;
+
+/*
+  A compiled Domain is a single block of memory: this header, followed
+  by the sections it lists. Every section starts on an 8-byte boundary
+  and holds a plain array, so the block can be written to a file as it
+  is and used again straight out of a memory mapping of that file,
+  without reading or converting anything.
+
+  Snapshots are meant to be used on the machine that wrote them, or
+  one just like it. Their numbers are in the writer's byte order, and
+  byte_order lets a reader notice when that isn't its own. Bump
+  current_version whenever the layout changes.
+*/
+struct DomainHeader {
+  static constexpr std::uint32_t current_version = 5;
+  static constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+  enum SectionId {
+    names,            // condition names, each ending in '\0'
+    name_offsets,     // where each condition's name starts in names
+    slots,            // SymbolSlots of the name lookup table
+    action_offsets,   // where each operator's name starts in actions
+    actions,          // action names, each ending in '\0'
+    pre_offsets,      // ConditionLists offsets of the preconditions
+    pre_conds,        // and the preconditions themselves
+    add_offsets,      // the same for the add lists
+    add_conds,
+    del_offsets,      // and for the delete lists
+    del_conds,
+    index_offsets,    // GoalIndex offsets, n_conditions + 1 of them
+    index_ops,        // GoalIndex OpIds
+    consumer_offsets, // the same for the ops that consume each condition
+    consumer_ops,
+    successor_nodes,  // SuccessorGenerator nodes, in the order they were built,
+    successor_ops,    // and the ops applicable at each; empty until save()
+    zobrist,          // one Zobrist key per condition, for State hashes
+    n_sections
+  };
+
+  struct Section {
+    std::uint64_t offset;
+    std::uint64_t size;
+  };
+
+  char magic[8];
+  std::uint32_t version;
+  std::uint32_t byte_order;
+  std::uint64_t image_size;
+  std::uint32_t n_conditions;
+  std::uint32_t n_ops;
+  Section sections[n_sections];
+};
+
+constexpr std::uint32_t DomainHeader::current_version;
+constexpr std::uint32_t DomainHeader::byte_order_mark;
+constexpr char domain_magic[8] = { 'G', 'P', 'S', 'D', 'O', 'M', '\0', '\n' };
+
+static_assert(sizeof(SymbolSlot) == 16, "SymbolSlot is part of the snapshot format");
+static_assert(sizeof(SuccessorNode) == 16, "SuccessorNode is part of the snapshot format");
+
+/*
+  A Domain is everything about a problem that doesn't change while we
+  solve it: the interned condition names, the operator table, and the
+  goal index built from that table. Once it's constructed nothing in
+  it is ever modified, so any number of Solvers, on any number of
+  threads, can share one Domain without locking.
+
+  Constructing a Domain from a SymbolTable and a list of Ops compiles
+  them into the flat layout described by DomainHeader, in memory the
+  Domain owns. save() writes that memory to a file, and map() gets a
+  Domain back by mapping the file, with no parsing and no copying.
+  Either way, the accessors below just index into the block.
+
+  The one exception is the successor generator. Only forward search
+  uses it, and for a big domain it takes longer to build than
+  everything else together, so a new Domain leaves it out and builds
+  it the first time successors() is called, once however many
+  threads ask. save() appends it to the snapshot, so a mapped Domain
+  has it from the start.
+*/
+class Domain {
+public:
+  Domain(const SymbolTable& symbols, const std::vector<Op>& ops);
+
+  Domain(const Domain&) = delete;
+  Domain& operator=(const Domain&) = delete;
+
+  static std::unique_ptr<Domain> map(const char* path);
+  bool save(const char* path) const;
+
+  std::size_t n_conditions() const { return n_conditions_; }
+  std::size_t n_ops() const { return action_offsets_.size(); }
+
+  const char* name(Condition c) const { return names_ + name_offsets_[c]; }
+
+  bool lookup(const char* name, std::size_t length, Condition& c) const {
+    const SymbolSlot& slot = slots_[find_symbol_slot(slots_.begin(), slots_.size(), names_,
+                                                     name, length, symbol_hash(name, length))];
+    if (slot.id == SymbolSlot::empty) {
+      return false;
+    }
+    c = slot.id;
+    return true;
+  }
+
+  bool lookup(const std::string& name, Condition& c) const {
+    return lookup(name.data(), name.size(), c);
+  }
+
+  const char* action(OpId id) const { return actions_ + action_offsets_[id]; }
+
+  Span<Condition> preconds(OpId id) const { return preconds_[id]; }
+  Span<Condition> adds(OpId id) const { return adds_[id]; }
+  Span<Condition> dels(OpId id) const { return dels_[id]; }
+
+  // The same lists for every operator at once.
+  const ConditionLists& precond_lists() const { return preconds_; }
+  const ConditionLists& add_lists() const { return adds_; }
+  const ConditionLists& del_lists() const { return dels_; }
+
+  Span<OpId> candidates(Condition goal) const { return index_.candidates(goal); }
+
+  // The operators with c among their preconditions, each listed once.
+  Span<OpId> consumers(Condition c) const { return consumers_.candidates(c); }
+
+  const SuccessorGenerator& successors() const {
+    std::call_once(successors_built_, [this] {
+      SuccessorGenerator::build(n_conditions_, preconds_, successor_nodes_, successor_ops_);
+      successors_ = SuccessorGenerator({ successor_nodes_.data(), successor_nodes_.data() + successor_nodes_.size() },
+                                       { successor_ops_.data(), successor_ops_.data() + successor_ops_.size() });
+    });
+    return successors_;
+  }
+
+  std::uint64_t zobrist_key(Condition c) const { return zobrist_[c]; }
+
+  /*
+    States made here carry the Domain's Zobrist keys, so their hash()
+    is kept up to date.
+  */
+  State make_state() const {
+    return State(n_conditions(), zobrist_.begin());
+  }
+
+  template<typename Container>
+  State make_state(const Container& conditions) const {
+    State state = make_state();
+    state.assign(conditions);
+    return state;
+  }
+
+private:
+  Domain() = default;
+
+  template<typename T>
+  static Span<T> section(const char* image, const DomainHeader::Section& s) {
+    const T* first = reinterpret_cast<const T*>(image + s.offset);
+    return { first, first + s.size / sizeof(T) };
+  }
+
+  void attach(const char* image);
+
+  std::vector<std::uint64_t> owned_;
+  MappedFile mapped_;
+  const char* image_ = nullptr;
+  std::size_t n_conditions_ = 0;
+  const char* names_ = nullptr;
+  Span<std::uint32_t> name_offsets_;
+  Span<SymbolSlot> slots_;
+  Span<std::uint32_t> action_offsets_;
+  const char* actions_ = nullptr;
+  ConditionLists preconds_;
+  ConditionLists adds_;
+  ConditionLists dels_;
+  GoalIndex index_;
+  GoalIndex consumers_;
+  mutable std::once_flag successors_built_;
+  mutable std::vector<SuccessorNode> successor_nodes_;
+  mutable std::vector<OpId> successor_ops_;
+  mutable SuccessorGenerator successors_;
+  Span<std::uint64_t> zobrist_;
+};
+
+Domain::Domain(const SymbolTable& symbols, const std::vector<Op>& ops) {
+  using H = DomainHeader;
+  std::size_t n_pre = 0, n_add = 0, n_del = 0, actions_size = 0;
+  for (const auto& op : ops) {
+    n_pre += op.preconds.size();
+    n_add += op.add_list.size();
+    n_del += op.del_list.size();
+    actions_size += op.action.size() + 1;
+  }
+  std::size_t list_offsets_size = (ops.size() + 1) * sizeof(std::uint32_t);
+  std::vector<std::uint32_t> index_offsets = GoalIndex::count(symbols.size(), ops);
+  std::vector<std::uint32_t> consumer_offsets = GoalIndex::count(symbols.size(), ops, &Op::preconds);
+
+  H header{};
+  std::copy(std::begin(domain_magic), std::end(domain_magic), header.magic);
+  header.version = H::current_version;
+  header.byte_order = H::byte_order_mark;
+  header.n_conditions = static_cast<std::uint32_t>(symbols.size());
+  header.n_ops = static_cast<std::uint32_t>(ops.size());
+  std::uint64_t sizes[H::n_sections] = {
+    symbols.pool().size(),
+    symbols.size() * sizeof(std::uint32_t),
+    symbols.slots().size() * sizeof(SymbolSlot),
+    ops.size() * sizeof(std::uint32_t),
+    actions_size,
+    list_offsets_size,
+    n_pre * sizeof(Condition),
+    list_offsets_size,
+    n_add * sizeof(Condition),
+    list_offsets_size,
+    n_del * sizeof(Condition),
+    index_offsets.size() * sizeof(std::uint32_t),
+    index_offsets.back() * sizeof(OpId),
+    consumer_offsets.size() * sizeof(std::uint32_t),
+    consumer_offsets.back() * sizeof(OpId),
+    0,
+    0,
+    symbols.size() * sizeof(std::uint64_t)
+  };
+  auto align = [](std::uint64_t n) { return (n + 7) & ~std::uint64_t{7}; };
+  std::uint64_t offset = align(sizeof(H));
+  for (int i = 0; i < H::n_sections; ++i) {
+    header.sections[i] = { offset, sizes[i] };
+    offset = align(offset + sizes[i]);
+  }
+  header.image_size = offset;
+
+  owned_.assign(offset / 8, 0);
+  char* image = reinterpret_cast<char*>(owned_.data());
+  auto at = [&](int i) { return image + header.sections[i].offset; };
+  std::memcpy(image, &header, sizeof header);
+  std::memcpy(at(H::names), symbols.pool().data(), symbols.pool().size());
+  std::memcpy(at(H::name_offsets), symbols.offsets().data(), sizes[H::name_offsets]);
+  std::memcpy(at(H::slots), symbols.slots().data(), sizes[H::slots]);
+
+  std::uint32_t* action_offsets = reinterpret_cast<std::uint32_t*>(at(H::action_offsets));
+  char* actions = at(H::actions);
+  std::uint32_t next_action = 0;
+  for (std::size_t i = 0; i < ops.size(); ++i) {
+    action_offsets[i] = next_action;
+    std::memcpy(actions + next_action, ops[i].action.c_str(), ops[i].action.size() + 1);
+    next_action += static_cast<std::uint32_t>(ops[i].action.size() + 1);
+  }
+  auto lists = [&](int offsets, int conds, std::vector<Condition> Op::* member) {
+    ConditionLists::fill(ops, member, reinterpret_cast<std::uint32_t*>(at(offsets)),
+                         reinterpret_cast<Condition*>(at(conds)));
+  };
+  lists(H::pre_offsets, H::pre_conds, &Op::preconds);
+  lists(H::add_offsets, H::add_conds, &Op::add_list);
+  lists(H::del_offsets, H::del_conds, &Op::del_list);
+
+  std::memcpy(at(H::index_offsets), index_offsets.data(), sizes[H::index_offsets]);
+  GoalIndex::fill(ops, index_offsets, reinterpret_cast<OpId*>(at(H::index_ops)));
+  std::memcpy(at(H::consumer_offsets), consumer_offsets.data(), sizes[H::consumer_offsets]);
+  GoalIndex::fill(ops, consumer_offsets, reinterpret_cast<OpId*>(at(H::consumer_ops)), &Op::preconds);
+
+  /*
+    The Zobrist keys come from splitmix64 with a fixed seed, so a
+    domain hashes its states the same way every time it's built and
+    in every snapshot of it, and hashes can be kept between runs.
+  */
+  std::uint64_t* keys = reinterpret_cast<std::uint64_t*>(at(H::zobrist));
+  std::uint64_t seed = 0x9e3779b97f4a7c15ull;
+  for (std::size_t c = 0; c < symbols.size(); ++c) {
+    std::uint64_t z = (seed += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    keys[c] = z ^ (z >> 31);
+  }
+
+  attach(image);
+}
+
+void Domain::attach(const char* image) {
+  using H = DomainHeader;
+  const H& header = *reinterpret_cast<const H*>(image);
+  image_ = image;
+  n_conditions_ = header.n_conditions;
+  names_ = image + header.sections[H::names].offset;
+  name_offsets_ = section<std::uint32_t>(image, header.sections[H::name_offsets]);
+  slots_ = section<SymbolSlot>(image, header.sections[H::slots]);
+  action_offsets_ = section<std::uint32_t>(image, header.sections[H::action_offsets]);
+  actions_ = image + header.sections[H::actions].offset;
+  auto lists = [&](int offsets, int conds) {
+    return ConditionLists(section<std::uint32_t>(image, header.sections[offsets]),
+                          section<Condition>(image, header.sections[conds]));
+  };
+  preconds_ = lists(H::pre_offsets, H::pre_conds);
+  adds_ = lists(H::add_offsets, H::add_conds);
+  dels_ = lists(H::del_offsets, H::del_conds);
+  index_ = GoalIndex(section<std::uint32_t>(image, header.sections[H::index_offsets]),
+                     section<OpId>(image, header.sections[H::index_ops]));
+  consumers_ = GoalIndex(section<std::uint32_t>(image, header.sections[H::consumer_offsets]),
+                         section<OpId>(image, header.sections[H::consumer_ops]));
+  if (header.sections[H::successor_nodes].size != 0) {
+    successors_ = SuccessorGenerator(section<SuccessorNode>(image, header.sections[H::successor_nodes]),
+                                     section<OpId>(image, header.sections[H::successor_ops]));
+    std::call_once(successors_built_, [] {});
+  }
+  zobrist_ = section<std::uint64_t>(image, header.sections[H::zobrist]);
+}
+
+/*
+  Map a snapshot written by save(). The header is checked, and so is
+  that every section lies inside the file, but the contents of the
+  sections are trusted: a snapshot is something we built ourselves,
+  and checking every ID would mean reading the whole file, which is
+  what mapping it is meant to avoid.
+*/
+std::unique_ptr<Domain> Domain::map(const char* path) {
+  using H = DomainHeader;
+  std::unique_ptr<Domain> domain(new Domain());
+  if (!domain->mapped_.open(path)) {
+    return nullptr;
+  }
+  const char* image = domain->mapped_.data();
+  std::size_t size = domain->mapped_.size();
+  const H* header = reinterpret_cast<const H*>(image);
+
+  const char* problem = nullptr;
+  if (size < sizeof(H) || !std::equal(std::begin(domain_magic), std::end(domain_magic), header->magic)) {
+    problem = "not a domain snapshot";
+  } else if (header->byte_order != H::byte_order_mark) {
+    problem = "snapshot was written with a different byte order";
+  } else if (header->version != H::current_version) {
+    problem = "snapshot was written by a different version of gps";
+  } else if (header->image_size != size) {
+    problem = "snapshot is truncated";
+  } else {
+    for (int i = 0; i < H::n_sections && problem == nullptr; ++i) {
+      const H::Section& s = header->sections[i];
+      if (s.offset % 8 != 0 || s.offset > size || s.size > size - s.offset) {
+        problem = "snapshot has a section out of bounds";
+      }
+    }
+  }
+  if (problem != nullptr) {
+    std::fprintf(stderr, "%s: %s\n", path, problem);
+    return nullptr;
+  }
+  domain->attach(image);
+  return domain;
+}
+
+bool Domain::save(const char* path) const {
+  std::FILE* out = std::fopen(path, "wb");
+  if (out == nullptr) {
+    std::fprintf(stderr, "%s: can't open for writing\n", path);
+    return false;
+  }
+  /*
+    A Domain that was built rather than mapped has no successor
+    generator in its image, so it is built now and written after the
+    rest, with the header changed to say where.
+  */
+  using H = DomainHeader;
+  H header = *reinterpret_cast<const H*>(image_);
+  std::uint64_t size = header.image_size;
+  Span<SuccessorNode> nodes = successors().nodes();
+  Span<OpId> ops = successors().ops();
+  bool append = header.sections[H::successor_nodes].size == 0;
+  if (append) {
+    auto align = [](std::uint64_t n) { return (n + 7) & ~std::uint64_t{7}; };
+    header.sections[H::successor_nodes] = { size, nodes.size() * sizeof(SuccessorNode) };
+    header.sections[H::successor_ops] = { align(size + header.sections[H::successor_nodes].size),
+                                          ops.size() * sizeof(OpId) };
+    header.image_size = align(header.sections[H::successor_ops].offset + header.sections[H::successor_ops].size);
+  }
+  const char zeros[8] = {};
+  auto write = [out](const void* data, std::uint64_t n) { return std::fwrite(data, 1, n, out) == n; };
+  bool ok = write(&header, sizeof header) && write(image_ + sizeof header, size - sizeof header);
+  if (append) {
+    const H::Section& s = header.sections[H::successor_ops];
+    ok = ok && write(nodes.begin(), header.sections[H::successor_nodes].size) &&
+         write(zeros, s.offset - size - header.sections[H::successor_nodes].size) &&
+         write(ops.begin(), s.size) && write(zeros, header.image_size - s.offset - s.size);
+  }
+  ok = (std::fclose(out) == 0) && ok;
+  if (!ok) {
+    std::fprintf(stderr, "%s: write error\n", path);
+  }
+  return ok;
+}
+
+/*
+  Applicable operators
+  --------------------
+
+  An operator is applicable when all of its preconditions hold.
+  Checking that from scratch means looking at every precondition of
+  every op, every time. ApplicableOps keeps the answer up to date
+  instead: each op has a count of its preconditions that don't hold,
+  and when a condition flips, only the ops that consume it (from the
+  Domain's consumer index) have their counts adjusted. An op whose
+  count drops to zero joins the applicable set, and one whose count
+  leaves zero drops out. The set is a dense array plus each op's
+  position in it, so joining and leaving are O(1), and listing the
+  applicable ops never looks at an op that isn't.
+
+  The tracker keeps its own copy of the state it describes. Tell it
+  about every condition that flips, in any order, or move it to a
+  whole new state and let it work out which ones did.
+*/
+class ApplicableOps {
+public:
+  explicit ApplicableOps(const Domain& domain)
+    : domain_ { domain },
+      holds_ { domain.n_conditions() },
+      unsatisfied_(domain.n_ops(), 0),
+      position_(domain.n_ops(), absent) { }
+
+  // Start over from state, counting every precondition.
+  void reset(const State& state) {
+    holds_.assign_words(state.words());
+    std::fill(std::begin(unsatisfied_), std::end(unsatisfied_), 0);
+    std::fill(std::begin(position_), std::end(position_), absent);
+    ops_.clear();
+    for (Condition c = 0; c < domain_.n_conditions(); ++c) {
+      if (!holds_.test(c)) {
+        for (auto op : domain_.consumers(c)) {
+          ++unsatisfied_[op];
+        }
+      }
+    }
+    for (OpId op = 0; op < domain_.n_ops(); ++op) {
+      if (unsatisfied_[op] == 0) {
+        insert(op);
+      }
+    }
+  }
+
+  void flip(Condition c) {
+    holds_.flip(c);
+    if (holds_.test(c)) {
+      for (auto op : domain_.consumers(c)) {
+        if (--unsatisfied_[op] == 0) {
+          insert(op);
+        }
+      }
+    } else {
+      for (auto op : domain_.consumers(c)) {
+        if (unsatisfied_[op]++ == 0) {
+          erase(op);
+        }
+      }
+    }
+  }
+
+  // Move to the state given by words, flipping whatever differs.
+  void move_to(const State::Word* words) {
+    const State::Word* old = holds_.words();
+    for (std::size_t i = 0; i < holds_.n_words(); ++i) {
+      for (State::Word changed = old[i] ^ words[i]; changed != 0; changed &= changed - 1) {
+        flip(static_cast<Condition>(i * State::bits_per_word + __builtin_ctzll(changed)));
+      }
+    }
+  }
+
+  bool applicable(OpId op) const { return unsatisfied_[op] == 0; }
+
+  // The applicable ops, in no particular order.
+  Span<OpId> ops() const { return { ops_.data(), ops_.data() + ops_.size() }; }
+
+private:
+  static constexpr std::uint32_t absent = ~std::uint32_t{0};
+
+  void insert(OpId op) {
+    position_[op] = static_cast<std::uint32_t>(ops_.size());
+    ops_.push_back(op);
+  }
+
+  void erase(OpId op) {
+    OpId last = ops_.back();
+    ops_[position_[op]] = last;
+    position_[last] = position_[op];
+    ops_.pop_back();
+    position_[op] = absent;
+  }
+
+  const Domain& domain_;
+  State holds_;
+  std::vector<std::uint32_t> unsatisfied_;
+  std::vector<std::uint32_t> position_;
+  std::vector<OpId> ops_;
+};
+
+constexpr std::uint32_t ApplicableOps::absent;
+
+/*
+  Most operators can't do anything for a given set of goals. An op is
+  relevant if it adds a goal, or adds a precondition of a relevant op;
+  everything else only ever adds conditions nobody needs, and since
+  STRIPS preconditions are never negative, leaving it out can't make
+  a problem unsolvable or a plan longer. RelevantOps works the set out
+  by chaining backwards from the goals through the goal index, so it
+  costs as much as the relevant part of the domain and no more.
+
+  GPS doesn't need it: achieve already only looks at the adders of the
+  goal in front of it, which is the same backward chaining done lazily.
+  Forward search is what benefits, since it otherwise generates a
+  successor for every applicable op.
+
+  Marks are stamped with a generation, so starting a new goal set
+  doesn't clear anything, and a warm RelevantOps doesn't allocate.
+*/
+class RelevantOps {
+public:
+  explicit RelevantOps(const Domain& domain)
+    : domain_ { domain },
+      condition_marks_(domain.n_conditions(), 0),
+      op_marks_(domain.n_ops(), 0) { }
+
+  template<typename Container>
+  void compute(const Container& goals) {
+    if (++generation_ == 0) {
+      std::fill(std::begin(condition_marks_), std::end(condition_marks_), 0);
+      std::fill(std::begin(op_marks_), std::end(op_marks_), 0);
+      generation_ = 1;
+    }
+    pending_.clear();
+    ops_.clear();
+    for (auto goal : goals) {
+      mark(goal);
+    }
+    while (!pending_.empty()) {
+      Condition c = pending_.back();
+      pending_.pop_back();
+      for (auto op : domain_.candidates(c)) {
+        if (op_marks_[op] != generation_) {
+          op_marks_[op] = generation_;
+          ops_.push_back(op);
+          for (auto p : domain_.preconds(op)) {
+            mark(p);
+          }
+        }
+      }
+    }
+  }
+
+  bool relevant(OpId op) const { return op_marks_[op] == generation_; }
+
+  // The relevant ops, in no particular order.
+  Span<OpId> ops() const { return { ops_.data(), ops_.data() + ops_.size() }; }
+
+private:
+  void mark(Condition c) {
+    if (condition_marks_[c] != generation_) {
+      condition_marks_[c] = generation_;
+      pending_.push_back(c);
+    }
+  }
+
+  const Domain& domain_;
+  std::uint32_t generation_ = 0;
+  std::vector<std::uint32_t> condition_marks_;
+  std::vector<std::uint32_t> op_marks_;
+  std::vector<Condition> pending_;
+  std::vector<OpId> ops_;
+};
+
+/*
+  Search statistics. Build with -DGPS_STATS and every Solver counts
+  what it does while it solves:
+
+    achieve_calls      calls to achieve, including ones that found the
+                       goal already true
+    candidates         operators taken out of the goal index and tried
+    ops_applied        operators whose preconditions were all achieved
+    ops_undone         applied operators taken back again because the
+                       branch they were on failed
+    transpositions     achieve calls answered from the transposition
+                       table instead of searched
+    max_depth          deepest nesting of goals being pursued at once
+    max_state_size     most conditions true at the same time
+    final_state_size   conditions true when the solve ended
+    nodes_expanded     states the best-first engines took off the
+                       open list and generated successors for
+    nodes_generated    successor states they generated, counting ones
+                       they had already seen
+    wall_ns            time spent inside GPS
+
+  Without -DGPS_STATS, the GPS_STAT macro throws its argument away, so
+  the counting code isn't there at all and the numbers stay zero. The
+  counters live in the Solver, and each thread has its own Solver, so
+  concurrent solves never share a counter.
+*/
+#ifdef GPS_STATS
+#define GPS_STAT(...) __VA_ARGS__
+constexpr bool stats_enabled = true;
+#else
+#define GPS_STAT(...)
+constexpr bool stats_enabled = false;
+#endif
+
+struct SearchStats {
+  std::uint64_t achieve_calls = 0;
+  std::uint64_t candidates = 0;
+  std::uint64_t ops_applied = 0;
+  std::uint64_t ops_undone = 0;
+  std::uint64_t transpositions = 0;
+  std::uint64_t max_depth = 0;
+  std::uint64_t max_state_size = 0;
+  std::uint64_t final_state_size = 0;
+  std::uint64_t nodes_expanded = 0;
+  std::uint64_t nodes_generated = 0;
+  std::uint64_t wall_ns = 0;
+};
+
+void write_json(std::FILE* out, const SearchStats& stats) {
+  std::fprintf(out,
+               "{\"achieve_calls\": %llu, \"candidates\": %llu, \"ops_applied\": %llu, "
+               "\"ops_undone\": %llu, \"transpositions\": %llu, \"max_depth\": %llu, \"max_state_size\": %llu, \"final_state_size\": %llu, "
+               "\"nodes_expanded\": %llu, \"nodes_generated\": %llu, \"wall_ns\": %llu}\n",
+               static_cast<unsigned long long>(stats.achieve_calls),
+               static_cast<unsigned long long>(stats.candidates),
+               static_cast<unsigned long long>(stats.ops_applied),
+               static_cast<unsigned long long>(stats.ops_undone),
+               static_cast<unsigned long long>(stats.transpositions),
+               static_cast<unsigned long long>(stats.max_depth),
+               static_cast<unsigned long long>(stats.max_state_size),
+               static_cast<unsigned long long>(stats.final_state_size),
+               static_cast<unsigned long long>(stats.nodes_expanded),
+               static_cast<unsigned long long>(stats.nodes_generated),
+               static_cast<unsigned long long>(stats.wall_ns));
+}
+
+/*
+  Best-first search
+  -----------------
+
+  achieve and apply_op are means-ends analysis: work backwards from a
+  goal to an operator that adds it, and commit to the first operator
+  whose preconditions can be achieved. That's quick when it works, but
+  it can't undo a choice, so it finds long plans, and it fails outright
+  on problems where achieving one goal clobbers another.
+
+  The other way to plan is to search forwards through states. Start
+  from the initial state; the successors of a state are the states you
+  get by applying each operator whose preconditions hold in it. Keep an
+  open list of states that have been generated but not yet expanded,
+  and always expand the most promising one next. How promising a state
+  is comes from a heuristic, h, which estimates how many more
+  operators it will take to reach the goals.
+
+    A*      expands the state with the smallest g + h, where g is the
+            number of operators on the path to it. If h never
+            overestimates, the first plan found is a shortest one.
+    GBFS    greedy best-first search expands the state with the
+            smallest h, and ignores how it got there. Plans are longer,
+            but it usually finds one after expanding far fewer states.
+
+  Every operator costs 1, so g and h are small integers, and the open
+  list can be an array of buckets, one per value of the key, rather
+  than a binary heap. Each bucket is a stack, linked through entries
+  that all come out of one pool: pushing takes the next entry and
+  links it in at the head, and popping unlinks the head of the lowest
+  bucket that isn't empty. Ties go to the state generated last, which
+  is usually the deepest. The pool only grows during a search and is
+  released all at once when the next one starts, keeping its memory,
+  so a search costs no allocations per bucket, and none at all once
+  the pool is as big as the searches need.
+
+  Each state is stored once, as its words in one big array, and the
+  closed set is an open-addressing hash table of node numbers keyed by
+  the state's Zobrist hash. A successor's hash is its parent's with
+  the keys of the changed conditions flipped, and each node stores its
+  hash, so no state is ever hashed from scratch. When A* reaches a state it has seen before
+  along a shorter path, it updates the node and pushes it again. The
+  entry left behind in the old bucket is stale; we recognise it when
+  it's popped because its key no longer matches, and skip it.
+*/
+enum class Engine { gps, gps_iterative, astar, gbfs };
+enum class Heuristic { blind, goal_count, max, add, ff };
+
+/*
+  How to solve a problem. The blind heuristic is 0 everywhere, which
+  makes A* a breadth-first search: slow, but its plans are the shortest
+  there are. goal_count is the number of goals that don't hold yet.
+  It's better informed, but it can overestimate, since one operator
+  can add several goals at once, so A* with it isn't guaranteed to
+  find the shortest plan. max, add and ff are the delete-relaxation
+  heuristics described below; of those only max never overestimates.
+  ff is the default, and usually the best choice for GBFS.
+
+  Forward search stores every state it generates. max_nodes puts a
+  limit on how many; a search that runs into it fails.
+
+  track_applicable has any engine keep an ApplicableOps up to date as
+  it goes. Forward search then generates successors from the
+  applicable set instead of walking the successor generator, and GPS executes
+  an operator whose preconditions all hold without achieving them one
+  by one. Plans are the same either way (gps --check-tracked checks);
+  what changes is whether the search pays per operator or per changed
+  condition. The search statistics do change for GPS: the achieve
+  calls it skips aren't counted, and since the transposition table
+  decides what to keep by how many achieve calls a result took, it
+  keeps different entries, which changes the transpositions count and
+  the work after a replay, though never an answer. That pays off for
+  forward search, which otherwise tests every operator at every node.
+  GPS already only looks at the few operators that add its goal, and
+  undoes a lot of what it applies, so for it the bookkeeping usually
+  costs more than it saves.
+
+  relevant_only has forward search ignore the operators RelevantOps
+  finds can't help with the goals. It doesn't change what GPS does.
+*/
+struct SolveOptions {
+  Engine engine = Engine::gps;
+  Heuristic heuristic = Heuristic::ff;
+  std::size_t max_nodes = std::size_t{1} << 20;
+  bool track_applicable = false;
+  bool relevant_only = true;
+};
+
+bool parse_engine(const std::string& name, Engine& engine) {
+  if (name == "gps") {
+    engine = Engine::gps;
+  } else if (name == "gps-iterative") {
+    engine = Engine::gps_iterative;
+  } else if (name == "astar") {
+    engine = Engine::astar;
+  } else if (name == "gbfs") {
+    engine = Engine::gbfs;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool parse_heuristic(const std::string& name, Heuristic& heuristic) {
+  if (name == "blind") {
+    heuristic = Heuristic::blind;
+  } else if (name == "goal-count") {
+    heuristic = Heuristic::goal_count;
+  } else if (name == "max") {
+    heuristic = Heuristic::max;
+  } else if (name == "add") {
+    heuristic = Heuristic::add;
+  } else if (name == "ff") {
+    heuristic = Heuristic::ff;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+/*
+  Delete relaxation
+  -----------------
+
+  The best heuristics for this kind of planning come from a relaxed
+  problem in which operators have no delete lists. Once a condition
+  holds it holds forever, so the relaxed problem never has to undo
+  anything, and how far a state is from the goals can be estimated by
+  working out how soon each condition could be reached:
+
+    cost(c)   = 0 if c holds in the state, otherwise
+                1 + the smallest cost(op) over the ops that add c
+    cost(op)  = the cost of its preconditions, combined by max (h_max)
+                or by + (h_add)
+
+  h_max is the largest goal cost. It never overestimates, so A* with
+  it still finds shortest plans, but it's a weak estimate. h_add is
+  the sum of the goal costs, which is much better informed but counts
+  shared subgoals more than once. h_FF takes the cheapest op found for
+  each condition by h_add (its supporter), chains back from the goals
+  to collect a relaxed plan, and counts the distinct ops in it. The
+  ops in that plan that are applicable right now are its helpful
+  actions, the ones that look like they're on the way to the goals.
+
+  The textbook way to compute costs repeats a pass over every
+  operator until nothing changes. We do it in one pass instead, like
+  Dijkstra's algorithm: each op keeps a counter of its preconditions
+  that haven't been reached yet, conditions are taken off a heap in
+  order of cost, and taking one off decrements the counters of the
+  ops that need it (found through the Domain's index from each
+  condition to its consumers). An op whose counter reaches zero has its cost, and
+  offers it to everything it adds. Every condition and every operator
+  is dealt with once per evaluation.
+
+  A state from which some goal can't be reached even in the relaxed
+  problem is a dead end, and evaluate() says so by returning
+  dead_end.
+*/
+class RelaxationHeuristic {
+public:
+  static constexpr std::uint32_t dead_end = ~std::uint32_t{0};
+
+  explicit RelaxationHeuristic(const Domain& domain);
+
+  template<typename Container>
+  std::uint32_t evaluate(const State& state, const Container& goals, Heuristic kind);
+
+  /*
+    The helpful actions found by the most recent h_FF evaluation.
+  */
+  const std::vector<OpId>& helpful() const { return helpful_; }
+
+private:
+  static constexpr std::uint32_t unreached = ~std::uint32_t{0};
+  static constexpr OpId no_op = ~OpId{0};
+
+  using Entry = std::pair<std::uint32_t, Condition>;
+
+  void reach(Condition c, std::uint32_t cost, OpId supporter) {
+    if (cost < cost_[c]) {
+      cost_[c] = cost;
+      supporter_[c] = supporter;
+      heap_.push_back(Entry{ cost, c });
+      std::push_heap(std::begin(heap_), std::end(heap_), std::greater<Entry>());
+    }
+  }
+
+  std::uint32_t relaxed_plan(const State& state);
+
+  /*
+    Start a new round of marks. 0 means unmarked, so when the counter
+    wraps around every mark is cleared, or ones from 2^32 rounds ago
+    would count as current.
+  */
+  void next_mark() {
+    if (++mark_ == 0) {
+      std::fill(std::begin(marked_), std::end(marked_), 0);
+      std::fill(std::begin(op_marked_), std::end(op_marked_), 0);
+      mark_ = 1;
+    }
+  }
+
+  const Domain& domain_;
+  std::vector<std::uint32_t> precond_counts_;
+  std::vector<OpId> free_ops_;
+  std::vector<std::uint32_t> cost_;
+  std::vector<OpId> supporter_;
+  std::vector<std::uint32_t> waiting_;
+  std::vector<std::uint32_t> op_cost_;
+  std::vector<Entry> heap_;
+  std::vector<Condition> goals_;
+  std::vector<Condition> stack_;
+  std::vector<std::uint32_t> marked_;
+  std::vector<std::uint32_t> op_marked_;
+  std::uint32_t mark_ = 0;
+  std::vector<OpId> helpful_;
+};
+
+constexpr std::uint32_t RelaxationHeuristic::dead_end;
+constexpr std::uint32_t RelaxationHeuristic::unreached;
+constexpr OpId RelaxationHeuristic::no_op;
+
+/*
+  The consumer index comes from the Domain, which lists each op once
+  per distinct precondition, so that's what the counters count.
+*/
+RelaxationHeuristic::RelaxationHeuristic(const Domain& domain)
+  : domain_ { domain },
+    precond_counts_(domain.n_ops(), 0),
+    cost_(domain.n_conditions()),
+    supporter_(domain.n_conditions()),
+    waiting_(domain.n_ops()),
+    op_cost_(domain.n_ops()),
+    marked_(domain.n_conditions(), 0),
+    op_marked_(domain.n_ops(), 0) {
+  for (Condition c = 0; c < domain.n_conditions(); ++c) {
+    for (auto op : domain.consumers(c)) {
+      ++precond_counts_[op];
+    }
+  }
+  for (OpId op = 0; op < domain.n_ops(); ++op) {
+    if (precond_counts_[op] == 0) {
+      free_ops_.push_back(op);
+    }
+  }
+}
+
+template<typename Container>
+std::uint32_t RelaxationHeuristic::evaluate(const State& state, const Container& goals, Heuristic kind) {
+  goals_.assign(std::begin(goals), std::end(goals));
+  helpful_.clear();
+  std::fill(std::begin(cost_), std::end(cost_), unreached);
+  std::copy(std::begin(precond_counts_), std::end(precond_counts_), std::begin(waiting_));
+  std::fill(std::begin(op_cost_), std::end(op_cost_), 0);
+  heap_.clear();
+  for (Condition c = 0; c < domain_.n_conditions(); ++c) {
+    if (state.test(c)) {
+      reach(c, 0, no_op);
+    }
+  }
+  for (auto op : free_ops_) {
+    for (auto c : domain_.adds(op)) {
+      reach(c, 1, op);
+    }
+  }
+
+  // Stop as soon as every goal has its final cost.
+  std::size_t goals_left = 0;
+  next_mark();
+  for (auto goal : goals_) {
+    if (marked_[goal] != mark_) {
+      marked_[goal] = mark_;
+      ++goals_left;
+    }
+  }
+  bool use_max = kind == Heuristic::max;
+  while (!heap_.empty() && goals_left > 0) {
+    std::pop_heap(std::begin(heap_), std::end(heap_), std::greater<Entry>());
+    Entry top = heap_.back();
+    heap_.pop_back();
+    Condition c = top.second;
+    if (top.first != cost_[c]) {
+      continue;  // stale: c was reached more cheaply since this entry was pushed
+    }
+    if (marked_[c] == mark_) {
+      marked_[c] = 0;
+      --goals_left;
+    }
+    for (auto op : domain_.consumers(c)) {
+      op_cost_[op] = use_max ? std::max(op_cost_[op], top.first) : op_cost_[op] + top.first;
+      if (--waiting_[op] == 0) {
+        for (auto added : domain_.adds(op)) {
+          reach(added, op_cost_[op] + 1, op);
+        }
+      }
+    }
+  }
+  if (goals_left > 0) {
+    return dead_end;
+  }
+
+  if (kind == Heuristic::ff) {
+    return relaxed_plan(state);
+  }
+  std::uint32_t h = 0;
+  for (auto goal : goals_) {
+    h = use_max ? std::max(h, cost_[goal]) : h + cost_[goal];
+  }
+  return h;
+}
+
+/*
+  Chain back from the goals through the supporters. Each supporter
+  is counted once however many conditions it's needed for, which is
+  what makes h_FF smaller than h_add when subgoals are shared.
+*/
+std::uint32_t RelaxationHeuristic::relaxed_plan(const State& state) {
+  next_mark();
+  std::uint32_t n_ops = 0;
+  stack_.assign(std::begin(goals_), std::end(goals_));
+  while (!stack_.empty()) {
+    Condition c = stack_.back();
+    stack_.pop_back();
+    if (marked_[c] == mark_ || state.test(c)) {
+      continue;
+    }
+    marked_[c] = mark_;
+    OpId op = supporter_[c];
+    if (op_marked_[op] == mark_) {
+      continue;
+    }
+    op_marked_[op] = mark_;
+    ++n_ops;
+    auto preconds = domain_.preconds(op);
+    if (std::all_of(std::begin(preconds), std::end(preconds),
+                    [&state](Condition p) { return state.test(p); })) {
+      helpful_.push_back(op);
+    }
+    stack_.insert(std::end(stack_), std::begin(preconds), std::end(preconds));
+  }
+  return n_ops;
+}
+
+class BestFirstSearch {
+public:
+  explicit BestFirstSearch(const Domain& domain)
+    : domain_ { domain },
+      current_ { domain.make_state() },
+      child_ { domain.make_state() } { }
+
+  /*
+    Search from state for a state where every goal holds. On success
+    plan is the path to it and state becomes that state. On failure
+    plan is empty and state is left as it was. The search keeps its
+    own copy of every state it visits, so state is only read at the
+    start and only written once the search is over.
+  */
+  template<typename Container>
+  bool run(State& state, const Container& goals, const SolveOptions& options,
+           std::vector<OpId>& plan, SearchStats& stats);
+
+private:
+  using NodeId = std::uint32_t;
+  static constexpr NodeId none = ~NodeId{0};
+
+  // An entry on the open list, and the one below it in its bucket.
+  struct OpenEntry {
+    NodeId node;
+    std::uint32_t next;
+  };
+  static constexpr std::uint32_t empty = ~std::uint32_t{0};
+
+  struct Node {
+    NodeId parent;
+    OpId op;
+    std::uint32_t g;
+    std::uint32_t h;
+    std::uint64_t hash;
+    bool expanded;
+  };
+
+  NodeId search(const State& initial, bool prune, SearchStats& stats);
+  bool generate(NodeId parent, OpId op, SearchStats& stats);
+
+  const State::Word* words(NodeId id) const { return &states_[std::size_t{id} * current_.n_words()]; }
+
+  /*
+    The relaxation heuristics need scratch space of their own, which
+    is only allocated the first time one of them is asked for.
+  */
+  std::uint32_t heuristic(const State& state) {
+    switch (options_.heuristic) {
+    case Heuristic::blind:
+      return 0;
+    case Heuristic::goal_count: {
+      std::uint32_t unsatisfied = 0;
+      for (auto goal : goals_) {
+        unsatisfied += !state.test(goal);
+      }
+      return unsatisfied;
+    }
+    default:
+      if (!relaxation_) {
+        relaxation_.reset(new RelaxationHeuristic(domain_));
+      }
+      return relaxation_->evaluate(state, goals_, options_.heuristic);
+    }
+  }
+
+  std::uint32_t key(const Node& node) const {
+    return options_.engine == Engine::astar ? node.g + node.h : node.h;
+  }
+
+  /*
+    Dead ends stay in the closed set, so they're recognised if they
+    turn up again, but they never go on the open list.
+  */
+  void push(NodeId id) {
+    if (nodes_[id].h == RelaxationHeuristic::dead_end) {
+      return;
+    }
+    std::uint32_t k = key(nodes_[id]);
+    if (k >= open_.size()) {
+      open_.resize(k + 1, empty);
+    }
+    open_pool_.push_back(OpenEntry{ id, open_[k] });
+    open_[k] = static_cast<std::uint32_t>(open_pool_.size() - 1);
+    lowest_ = std::min<std::size_t>(lowest_, k);
+  }
+
+  /*
+    The slot in the closed set for state, which holds either the node
+    that has that state or none.
+  */
+  std::size_t find_slot(const State& state, std::uint64_t hash) const {
+    std::size_t mask = table_.size() - 1;
+    for (std::size_t i = hash & mask;; i = (i + 1) & mask) {
+      NodeId id = table_[i];
+      if (id == none || (nodes_[id].hash == hash &&
+                         std::equal(state.words(), state.words() + state.n_words(), words(id)))) {
+        return i;
+      }
+    }
+  }
+
+  void grow_table() {
+    std::vector<NodeId> old(table_.size() * 2, none);
+    table_.swap(old);
+    std::size_t mask = table_.size() - 1;
+    for (auto id : old) {
+      if (id != none) {
+        std::size_t i = nodes_[id].hash & mask;
+        while (table_[i] != none) {
+          i = (i + 1) & mask;
+        }
+        table_[i] = id;
+      }
+    }
+  }
+
+  /*
+    In a pruned search, h_FF has just found the node's helpful actions
+    along with its h, so they're kept for when it's expanded rather
+    than worked out again then. They go end to end in helpful_ops_, in
+    node order, and the actions of node n are helpful_ops_ from
+    helpful_offsets_[n] up to helpful_offsets_[n + 1].
+  */
+  NodeId add_node(const State& state, std::uint64_t hash, NodeId parent, OpId op, std::uint32_t g,
+                  std::size_t slot) {
+    NodeId id = static_cast<NodeId>(nodes_.size());
+    nodes_.push_back(Node{ parent, op, g, heuristic(state), hash, false });
+    if (prune_) {
+      const auto& helpful = relaxation_->helpful();
+      helpful_ops_.insert(std::end(helpful_ops_), std::begin(helpful), std::end(helpful));
+      helpful_offsets_.push_back(static_cast<std::uint32_t>(helpful_ops_.size()));
+    }
+    states_.insert(std::end(states_), state.words(), state.words() + state.n_words());
+    table_[slot] = id;
+    if (2 * nodes_.size() > table_.size()) {
+      grow_table();
+    }
+    return id;
+  }
+
+  const Domain& domain_;
+  SolveOptions options_;
+  std::vector<Condition> goals_;
+  std::vector<Node> nodes_;
+  std::vector<State::Word> states_;
+  std::vector<NodeId> table_;
+  std::vector<std::uint32_t> open_;
+  std::vector<OpenEntry> open_pool_;
+  std::size_t lowest_ = 0;
+  State current_;
+  State child_;
+  std::unique_ptr<RelaxationHeuristic> relaxation_;
+  bool prune_ = false;
+  std::vector<std::uint32_t> helpful_offsets_;
+  std::vector<OpId> helpful_ops_;
+  std::unique_ptr<ApplicableOps> applicable_;
+  std::vector<OpId> successors_;
+  std::vector<std::uint32_t> successor_stack_;
+  std::unique_ptr<RelevantOps> relevant_;
+};
+
+constexpr BestFirstSearch::NodeId BestFirstSearch::none;
+constexpr std::uint32_t BestFirstSearch::empty;
+
+template<typename Container>
+bool BestFirstSearch::run(State& state, const Container& goals, const SolveOptions& options,
+                          std::vector<OpId>& plan, SearchStats& stats) {
+  options_ = options;
+  goals_.assign(std::begin(goals), std::end(goals));
+  plan.clear();
+  if (options_.relevant_only) {
+    if (!relevant_) {
+      relevant_.reset(new RelevantOps(domain_));
+    }
+    relevant_->compute(goals_);
+  }
+  bool prune = options_.engine == Engine::gbfs && options_.heuristic == Heuristic::ff;
+  NodeId goal = search(state, prune, stats);
+  if (goal == none && prune) {
+    goal = search(state, false, stats);
+  }
+  if (goal == none) {
+    return false;
+  }
+  for (NodeId n = goal; nodes_[n].parent != none; n = nodes_[n].parent) {
+    plan.push_back(nodes_[n].op);
+  }
+  std::reverse(std::begin(plan), std::end(plan));
+  state.assign_words(words(goal), nodes_[goal].hash);
+  return true;
+}
+
+/*
+  GBFS with h_FF only generates the successors reached by a helpful
+  action of the state being expanded, as FF does. On domains with
+  hundreds of applicable operators per state, most of which do nothing
+  for the goals, that's the difference between a search that finishes
+  and one that doesn't. Pruning can throw away every way to the goals,
+  though, so run() searches again without it when a pruned search
+  fails.
+*/
+BestFirstSearch::NodeId BestFirstSearch::search(const State& initial, bool prune, SearchStats& stats) {
+  static_cast<void>(stats);  // only counted with -DGPS_STATS
+  nodes_.clear();
+  states_.clear();
+  // Keep the closed set as big as it has ever had to be, so that a
+  // reused BestFirstSearch doesn't have to grow it again.
+  if (table_.empty()) {
+    table_.assign(1024, none);
+  } else {
+    std::fill(std::begin(table_), std::end(table_), none);
+  }
+  std::fill(std::begin(open_), std::end(open_), empty);
+  open_pool_.clear();
+  lowest_ = 0;
+  prune_ = prune;
+  helpful_offsets_.assign(1, 0);
+  helpful_ops_.clear();
+
+  current_.assign_words(initial.words());
+  std::uint64_t hash = current_.hash();
+  push(add_node(current_, hash, none, 0, 0, find_slot(current_, hash)));
+  // Pruned expansion only looks at helpful actions, so there is
+  // nothing for the tracker to save it.
+  bool track = options_.track_applicable && !prune;
+  if (track) {
+    if (!applicable_) {
+      applicable_.reset(new ApplicableOps(domain_));
+    }
+    applicable_->reset(current_);
+  }
+  const SuccessorGenerator* tree = track || prune ? nullptr : &domain_.successors();
+
+  while (lowest_ < open_.size()) {
+    if (open_[lowest_] == empty) {
+      ++lowest_;
+      continue;
+    }
+    NodeId id = open_pool_[open_[lowest_]].node;
+    open_[lowest_] = open_pool_[open_[lowest_]].next;
+    if (nodes_[id].expanded || key(nodes_[id]) != lowest_) {
+      continue;
+    }
+    nodes_[id].expanded = true;
+    if (track) {
+      applicable_->move_to(words(id));
+    }
+    current_.assign_words(words(id), nodes_[id].hash);
+
+    /*
+      Testing for the goals when a state is expanded, rather than when
+      it's generated, is what makes A* return a shortest plan.
+    */
+    if (std::all_of(std::begin(goals_), std::end(goals_),
+                    [this](Condition goal) { return current_.test(goal); })) {
+      return id;
+    }
+
+    GPS_STAT(++stats.nodes_expanded);
+    if (prune) {
+      // The helpful actions are applicable, and relevant, by construction.
+      // generate() adds to helpful_ops_, so they're read by index.
+      for (std::uint32_t i = helpful_offsets_[id]; i < helpful_offsets_[id + 1]; ++i) {
+        if (!generate(id, helpful_ops_[i], stats)) {
+          return none;
+        }
+      }
+      continue;
+    }
+    if (track) {
+      auto applicable = applicable_->ops();
+      successors_.assign(std::begin(applicable), std::end(applicable));
+    } else {
+      tree->applicable(current_, successors_, successor_stack_);
+    }
+    if (options_.relevant_only) {
+      successors_.erase(std::remove_if(std::begin(successors_), std::end(successors_),
+                                       [this](OpId op) { return !relevant_->relevant(op); }),
+                        std::end(successors_));
+    }
+    // In operator order, so that ties are broken the same way however
+    // the applicable ops were found.
+    std::sort(std::begin(successors_), std::end(successors_));
+    for (auto op : successors_) {
+      if (!generate(id, op, stats)) {
+        return none;
+      }
+    }
+  }
+  return none;
+}
+
+/*
+  Apply op to the state being expanded, and add the result to the
+  search unless we've been there before by a path at least as short.
+  Returns false if the search has run out of nodes.
+*/
+bool BestFirstSearch::generate(NodeId parent, OpId op, SearchStats& stats) {
+  static_cast<void>(stats);
+  child_ = current_;
+  child_.apply(domain_.dels(op), domain_.adds(op));
+  GPS_STAT(++stats.nodes_generated);
+  std::uint64_t h = child_.hash();
+  std::size_t slot = find_slot(child_, h);
+  NodeId seen = table_[slot];
+  std::uint32_t g = nodes_[parent].g + 1;
+  if (seen == none) {
+    if (nodes_.size() >= options_.max_nodes) {
+      return false;
+    }
+    push(add_node(child_, h, parent, op, g, slot));
+  } else if (options_.engine == Engine::astar && g < nodes_[seen].g) {
+    nodes_[seen].parent = parent;
+    nodes_[seen].op = op;
+    nodes_[seen].g = g;
+    nodes_[seen].expanded = false;
+    push(seen);
+  }
+  return true;
+}
+
+/*
+  Transposition table
+  -------------------
+
+  Once a branch fails and is undone, the next candidate often needs
+  some of the same subgoals, and achieve works them out again from the
+  same state. Those are transpositions: the same position reached by a
+  different path. What achieve(goal) does depends only on the state,
+  the goals already on the goal stack, and the goal itself, so once
+  we've seen the outcome we can remember it. A failure is remembered
+  as just that (a nogood), and a success as the sub-plan it appended,
+  which can be applied again without searching.
+
+  The table is fixed-size and lossy. It's an array of 64-byte buckets,
+  each aligned to a cache line and holding four entries, so a probe
+  touches one line. A position is looked up by its key, a 64-bit mix
+  of the state hash, the goal-stack hash and the goal, and the bucket
+  is picked by the low bits of the key. When the bucket is full, a new
+  entry replaces the one that took the least work to find, counted in
+  achieve calls; a result that was cheap to find is cheap to find
+  again.
+
+  A key is only 64 bits, and two positions whose keys collide must
+  not share an answer, or GPS would replay a plan, or give up on a
+  goal, for a position it has never seen. So every entry also points
+  to a record of its position, kept in an array beside the table: the
+  goal, then the state's words and the goal stack's words. A probe
+  whose key matches still compares the record with the position
+  being looked up, and only an exact match is a hit. That costs a few
+  words compared per hit, and never happens on a miss.
+
+  Records and sub-plans live end to end in two arrays. When either is
+  full both start over, and everything stored so far is forgotten.
+  Rather than sweep the whole table, every entry is stamped with the
+  generation it was stored in, and an entry from an older generation
+  no longer counts. Only when the 8-bit generation wraps around is
+  the table swept. Nothing in it depends on the problem being solved,
+  only on the Domain, so the table is kept between solves.
+*/
+class TranspositionTable {
+public:
+  static constexpr std::uint16_t failed = 0xffff;
+
+  struct Entry {
+    std::uint64_t key;
+    std::uint32_t record;       // where its position starts in the records array
+    std::uint16_t length;       // how many ops its sub-plan has, or failed
+    std::uint8_t work;          // achieve calls it took, up to 255; 0 marks an empty entry
+    std::uint8_t generation;
+  };
+
+  /*
+    n_words is how many words a State of the Domain has. The arrays
+    grow as entries are stored, up to max_record_words words of
+    records and max_plan_ops ops of sub-plans.
+  */
+  explicit TranspositionTable(std::size_t n_words,
+                              std::size_t n_buckets = std::size_t{1} << 12,
+                              std::size_t max_record_words = std::size_t{1} << 17,
+                              std::size_t max_plan_ops = std::size_t{1} << 16)
+    : n_words_ { n_words },
+      n_buckets_ { n_buckets },
+      max_record_words_ { max_record_words },
+      max_plan_ops_ { max_plan_ops } {
+    void* p = nullptr;
+    if (::posix_memalign(&p, sizeof(Bucket), n_buckets * sizeof(Bucket)) != 0) {
+      throw std::bad_alloc();
+    }
+    buckets_.reset(static_cast<Bucket*>(p));
+    std::fill(buckets_.get(), buckets_.get() + n_buckets_, Bucket{});
+  }
+
+  static std::uint64_t key(std::uint64_t state, std::uint64_t goal_stack, std::uint64_t goal) {
+    std::uint64_t k = state ^ ((goal_stack << 31) | (goal_stack >> 33)) ^ (goal * 0x9e3779b97f4a7c15ull);
+    k = (k ^ (k >> 33)) * 0xff51afd7ed558ccdull;
+    return k ^ (k >> 33);
+  }
+
+  const Entry* find(std::uint64_t key, Condition goal, const State& state, const State& goal_stack) const {
+    const Bucket& bucket = buckets_.get()[key & (n_buckets_ - 1)];
+    for (const auto& e : bucket.entries) {
+      if (e.key == key && live(e) && matches(e, goal, state.words(), goal_stack.words())) {
+        return &e;
+      }
+    }
+    return nullptr;
+  }
+
+  /*
+    Remember that goal failed from state with goal_stack. state is the
+    state the search started from; a failed search puts it back.
+  */
+  void store_failure(std::uint64_t key, Condition goal, const State& state, const State& goal_stack,
+                     std::uint64_t work) {
+    if (!make_room(0)) {
+      return;
+    }
+    std::uint32_t at = add_record(goal, 0, state, goal_stack);
+    store(key, at, failed, work);
+  }
+
+  /*
+    Remember that goal was achieved by the ops from first to last.
+    state is the state they left behind, and the search started from
+    the state before the changes on trail, which are undone in the
+    record. Sub-plans too long to fit an entry aren't stored.
+  */
+  void store_plan(std::uint64_t key, Condition goal, const State& state, const State& goal_stack,
+                  Span<Condition> trail, const OpId* first, const OpId* last, std::uint64_t work) {
+    std::size_t length = static_cast<std::size_t>(last - first);
+    if (length >= failed || !make_room(length)) {
+      return;
+    }
+    std::uint32_t plan_at = static_cast<std::uint32_t>(plans_.size());
+    plans_.insert(std::end(plans_), first, last);
+    std::uint32_t at = add_record(goal, plan_at, state, goal_stack);
+    State::Word* words = &records_[at + 1];
+    for (auto c : trail) {
+      words[c / State::bits_per_word] ^= State::Word{1} << (c % State::bits_per_word);
+    }
+    store(key, at, static_cast<std::uint16_t>(length), work);
+  }
+
+  // Forget everything, keeping the memory. Like running out of room,
+  // this starts a new generation instead of sweeping the table.
+  void clear() {
+    next_generation();
+  }
+
+  Span<OpId> plan(const Entry& e) const {
+    const OpId* first = plans_.data() + (records_[e.record] >> 32);
+    return { first, first + e.length };
+  }
+
+private:
+  struct alignas(64) Bucket {
+    Entry entries[4];
+  };
+  static_assert(sizeof(Bucket) == 64, "a Bucket is one cache line");
+
+  struct FreeDeleter {
+    void operator()(void* p) const { std::free(p); }
+  };
+
+  bool live(const Entry& e) const {
+    return e.work != 0 && e.generation == generation_;
+  }
+
+  // A record is the goal and where its sub-plan starts, then the words
+  // of the state, then the words of the goal stack.
+  std::size_t record_words() const { return 1 + 2 * n_words_; }
+
+  bool matches(const Entry& e, Condition goal, const State::Word* state, const State::Word* goal_stack) const {
+    const State::Word* record = &records_[e.record];
+    return static_cast<Condition>(record[0]) == goal &&
+           std::equal(state, state + n_words_, record + 1) &&
+           std::equal(goal_stack, goal_stack + n_words_, record + 1 + n_words_);
+  }
+
+  // Start a new generation if a record and length ops won't fit.
+  bool make_room(std::size_t length) {
+    if (record_words() > max_record_words_ || length > max_plan_ops_) {
+      return false;
+    }
+    if (records_.size() + record_words() > max_record_words_ || plans_.size() + length > max_plan_ops_) {
+      next_generation();
+    }
+    return true;
+  }
+
+  std::uint32_t add_record(Condition goal, std::uint32_t plan_at, const State& state, const State& goal_stack) {
+    std::uint32_t at = static_cast<std::uint32_t>(records_.size());
+    records_.push_back(goal | (State::Word{plan_at} << 32));
+    records_.insert(std::end(records_), state.words(), state.words() + n_words_);
+    records_.insert(std::end(records_), goal_stack.words(), goal_stack.words() + n_words_);
+    return at;
+  }
+
+  void next_generation() {
+    records_.clear();
+    plans_.clear();
+    if (++generation_ == 0) {
+      std::fill(buckets_.get(), buckets_.get() + n_buckets_, Bucket{});
+    }
+  }
+
+  void store(std::uint64_t key, std::uint32_t record, std::uint16_t length, std::uint64_t work) {
+    Bucket& bucket = buckets_.get()[key & (n_buckets_ - 1)];
+    Entry* victim = &bucket.entries[0];
+    for (auto& e : bucket.entries) {
+      if (e.key == key || !live(e)) {
+        victim = &e;
+        break;
+      }
+      if (e.work < victim->work) {
+        victim = &e;
+      }
+    }
+    *victim = Entry{ key, record, length, static_cast<std::uint8_t>(std::min<std::uint64_t>(work, 0xff)),
+                     generation_ };
+  }
+
+  std::size_t n_words_;
+  std::size_t n_buckets_;
+  std::size_t max_record_words_;
+  std::size_t max_plan_ops_;
+  std::unique_ptr<Bucket, FreeDeleter> buckets_;
+  std::vector<State::Word> records_;
+  std::vector<OpId> plans_;
+  std::uint8_t generation_ = 0;
+};
+
+constexpr std::uint16_t TranspositionTable::failed;
+
+/*
+  The Lisp program keeps the current state and the operators in the
+  special variables *state* and *ops*, and GPS rebinds them for the
+  duration of a call. A global variable in C++ can't be rebound like
+  that, and while one solve is using it nobody else can.
+
+  So a Solver carries that context around instead. It holds a
+  reference to a shared Domain, and owns the mutable things: the
+  current state and the plan built so far. Solvers are cheap, and each
+  thread that wants to solve problems should have its own. The GPS
+  engines also want a transposition table, of a few hundred kilobytes
+  and up, which a Solver only allocates the first time one of them
+  runs; a Solver that only does forward search never has one. A Solver
+  can be reused for many problems; its buffers are kept between calls.
+*/
+class Solver {
+public:
+  explicit Solver(const Domain& domain)
+    : domain_ { domain },
+      state_ { domain.make_state() },
+      goal_stack_ { domain.make_state() },
+      search_ { domain } { }
+
+  /*
+    Achieve every goal starting from state. Whether or not it
+    succeeds, plan() afterwards lists the operators that were executed,
+    in order, and state() is the state they left behind. Operators
+    tried on a branch that failed have been taken back, so they're in
+    neither.
+  */
+  template<typename Container>
+  bool GPS(const State& state, const Container& goals) {
+    state_.assign_words(state.words());
+    return run(goals, SolveOptions{});
+  }
+
+  /*
+    The same, starting from the state where exactly the conditions in
+    initial hold. The solver's own state is overwritten in place, so a
+    Solver that has been used once before solves without allocating
+    anything, apart from growing its plan the first time it needs to.
+  */
+  template<typename Container>
+  bool GPS(const std::vector<Condition>& initial, const Container& goals) {
+    state_.assign(initial);
+    return run(goals, SolveOptions{});
+  }
+
+  /*
+    Solve with whichever engine options asks for. Engine::gps is the
+    means-ends analysis above, and Engine::gps_iterative is the same
+    search without the recursion; the others are the forward searches
+    done by BestFirstSearch. plan() and state() mean the same thing
+    afterwards either way.
+  */
+  template<typename Container>
+  bool solve(const std::vector<Condition>& initial, const Container& goals, const SolveOptions& options) {
+    state_.assign(initial);
+    if (options.engine == Engine::gps || options.engine == Engine::gps_iterative) {
+      return run(goals, options);
+    }
+    GPS_STAT(stats_ = SearchStats{};
+             stats_.max_state_size = state_.count();
+             auto start = std::chrono::steady_clock::now());
+    bool solved = search_.run(state_, goals, options, plan_, stats_);
+    GPS_STAT(stats_.final_state_size = state_.count();
+             stats_.wall_ns = static_cast<std::uint64_t>(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - start).count()));
+    return solved;
+  }
+
+  const std::vector<OpId>& plan() const { return plan_; }
+  const State& state() const { return state_; }
+
+  /*
+    Forget every achieve outcome the GPS engines have remembered, so
+    the next solve searches as if the Solver had never been used. The
+    table keeps its memory.
+  */
+  void clear_transpositions() {
+    if (transpositions_) {
+      transpositions_->clear();
+    }
+  }
+
+  /*
+    Counters for the most recent solve. They're only filled in when
+    the program is built with -DGPS_STATS.
+  */
+  const SearchStats& stats() const { return stats_; }
+
+private:
+  template<typename Container>
+  bool run(const Container& goals, const SolveOptions& options) {
+    plan_.clear();
+    trail_.clear();
+    if (!transpositions_) {
+      transpositions_.reset(new TranspositionTable(state_.n_words()));
+    }
+    track_ = options.track_applicable;
+    if (track_) {
+      if (!applicable_) {
+        applicable_.reset(new ApplicableOps(domain_));
+      }
+      applicable_->reset(state_);
+    }
+    bool iterative = options.engine == Engine::gps_iterative;
+    GPS_STAT(stats_ = SearchStats{};
+             depth_ = 0;
+             stats_.max_state_size = state_.count();
+             auto start = std::chrono::steady_clock::now());
+    bool solved = std::all_of(std::begin(goals), std::end(goals),
+                              [this, iterative](Condition goal) {
+                                return iterative ? achieve_iterative(goal) : achieve(goal);
+                              });
+    GPS_STAT(stats_.final_state_size = state_.count();
+             stats_.wall_ns = static_cast<std::uint64_t>(
+               std::chrono::duration_cast<std::chrono::nanoseconds>(
+                 std::chrono::steady_clock::now() - start).count()));
+    return solved;
+  }
+
+  /*
+    A goal that achieve is searching for, and where the search is up
+    to; see achieve_iterative. trail_mark and plan_mark are how long
+    the trail and the plan were when the search started, and
+    work_before is what work_ was.
+  */
+  struct Frame {
+    Condition goal;
+    std::uint32_t candidate;
+    std::uint32_t precond;
+    std::uint32_t trail_mark;
+    std::uint32_t plan_mark;
+    std::uint64_t key;
+    std::uint64_t work_before;
+  };
+
+  enum class Opened { achieved, failed, search };
+
+  bool achieve(Condition goal);
+  bool apply_op(OpId id);
+  bool achieve_iterative(Condition goal);
+  void execute(OpId id);
+  void apply_effects(OpId id);
+  Opened open_goal(Condition goal, Frame& frame);
+  void undo_candidate(const Frame& frame);
+  void close_goal(const Frame& frame, bool achieved);
+
+  const Domain& domain_;
+  State state_;
+  State goal_stack_;
+  std::vector<OpId> plan_;
+  std::vector<Condition> trail_;
+  std::vector<Frame> frames_;
+  std::unique_ptr<TranspositionTable> transpositions_;
+  std::uint64_t work_ = 0;
+  bool track_ = false;
+  std::unique_ptr<ApplicableOps> applicable_;
+  SearchStats stats_;
+  BestFirstSearch search_;
+  GPS_STAT(std::uint64_t depth_ = 0;)
+};
+
+/*
+  The functions apply_op and achieve call each other. As members of
+  the same class they can see each other's declarations, so unlike
+  free functions neither one has to be declared before the other.
+
+  The function std::all_of returns true if its third argument, a
+  predicate, returns true for all elements in the container.
+
+  Rather than printing as it goes, apply_op records the operator in
+  the plan; printing is left to whoever called GPS.
+*/
+bool Solver::apply_op(OpId id) {
+  auto preconds = domain_.preconds(id);
+  if ((track_ && applicable_->applicable(id)) ||
+      std::all_of(std::begin(preconds), std::end(preconds),
+                  [this](Condition goal) { return achieve(goal); })) {
+    execute(id);
+    return true;
+  } else {
+    return false;
+  }
+}
+
+void Solver::execute(OpId id) {
+  plan_.push_back(id);
+  apply_effects(id);
+  GPS_STAT(++stats_.ops_applied;
+           stats_.max_state_size = std::max<std::uint64_t>(stats_.max_state_size, state_.count()));
+}
+
+/*
+  Every change the solver makes to its state goes through the trail,
+  so the trail is also where the applicability tracker finds out what
+  flipped.
+*/
+void Solver::apply_effects(OpId id) {
+  std::size_t mark = trail_.size();
+  state_.apply(domain_.dels(id), domain_.adds(id), trail_);
+  if (track_) {
+    for (std::size_t i = mark; i < trail_.size(); ++i) {
+      applicable_->flip(trail_[i]);
+    }
+  }
+}
+
+/*
+  The function std::any_of returns true if its third argument, a
+  predicate, returns true on at least one of the elements in the
+  container.
+
+  Like the Lisp (or ...), we only go looking for an operator when the
+  goal doesn't already hold. Testing the goal is one bit probe, and
+  the appropriate operators come straight out of the goal index
+  instead of a find_all over every operator.
+
+  goal_stack_ holds the goals we're in the middle of achieving. If a
+  goal turns up again as a subgoal of itself, pursuing it can only
+  lead around the same loop, so we give up on this branch right away.
+  This is the goal-stack refinement from later in PAIP chapter 4,
+  except that the stack is a bitset, so the check is one bit probe
+  rather than a member over a list. A goal is never pushed twice, so
+  pushing and popping are just setting and clearing its bit.
+
+  A candidate that fails may already have applied operators for the
+  preconditions it did achieve. Their effects would otherwise stay in
+  the state, and the next candidate would be tried in a world that
+  doesn't match the plan. So before each candidate we note how long
+  the trail and the plan are, and if it fails we undo the trail back
+  to that point and cut the plan back to match. Nothing is copied on
+  the way in; a failed branch costs one bit flip per change it made.
+  Every failed candidate is undone, so the marks are the same for
+  all of a goal's candidates, and open_goal takes them once.
+
+  Before searching, we ask the transposition table whether we've
+  already pursued this goal from this state with this goal stack. If
+  so we replay the answer, applying the remembered sub-plan through
+  the trail as if we'd found it again, so a caller can still undo it.
+  Goals with no candidates fail in a single call, and aren't worth
+  an entry. Nor is a success that searched little more than it
+  applied: replaying it would save next to nothing, and sub-plans
+  nested inside each other would copy the same ops over and over.
+
+  Everything but the loop over the candidates is in open_goal and
+  close_goal, which the iterative engine below shares.
+*/
+bool Solver::achieve(Condition goal) {
+  Frame frame;
+  Opened opened = open_goal(goal, frame);
+  if (opened != Opened::search) {
+    return opened == Opened::achieved;
+  }
+  auto candidates = domain_.candidates(goal);
+  bool achieved = std::any_of(std::begin(candidates), std::end(candidates),
+                              [this, &frame](OpId op) {
+                                GPS_STAT(++stats_.candidates);
+                                if (apply_op(op)) {
+                                  return true;
+                                }
+                                undo_candidate(frame);
+                                return false;
+                              });
+  close_goal(frame, achieved);
+  return achieved;
+}
+
+Solver::Opened Solver::open_goal(Condition goal, Frame& frame) {
+  GPS_STAT(++stats_.achieve_calls);
+  ++work_;
+  if (state_.test(goal)) {
+    return Opened::achieved;
+  }
+  if (goal_stack_.test(goal)) {
+    return Opened::failed;
+  }
+  std::uint64_t key = TranspositionTable::key(state_.hash(), goal_stack_.hash(), domain_.zobrist_key(goal));
+  if (const TranspositionTable::Entry* known = transpositions_->find(key, goal, state_, goal_stack_)) {
+    GPS_STAT(++stats_.transpositions);
+    if (known->length == TranspositionTable::failed) {
+      return Opened::failed;
+    }
+    for (auto op : transpositions_->plan(*known)) {
+      plan_.push_back(op);
+      apply_effects(op);
+    }
+    return Opened::achieved;
+  }
+  frame = Frame{ goal, 0, 0, static_cast<std::uint32_t>(trail_.size()),
+                 static_cast<std::uint32_t>(plan_.size()), key, work_ };
+  goal_stack_.set(goal);
+  GPS_STAT(stats_.max_depth = std::max(stats_.max_depth, ++depth_));
+  return Opened::search;
+}
+
+void Solver::undo_candidate(const Frame& frame) {
+  if (track_) {
+    for (std::size_t i = frame.trail_mark; i < trail_.size(); ++i) {
+      applicable_->flip(trail_[i]);
+    }
+  }
+  state_.undo(trail_, frame.trail_mark);
+  GPS_STAT(stats_.ops_undone += plan_.size() - frame.plan_mark);
+  plan_.resize(frame.plan_mark);
+}
+
+void Solver::close_goal(const Frame& frame, bool achieved) {
+  GPS_STAT(--depth_);
+  goal_stack_.reset(frame.goal);
+  std::uint64_t work = work_ - frame.work_before + 1;
+  std::size_t length = plan_.size() - frame.plan_mark;
+  if (!achieved && work > 1) {
+    transpositions_->store_failure(frame.key, frame.goal, state_, goal_stack_, work);
+  } else if (achieved && work > 4 * (length + 1)) {
+    transpositions_->store_plan(frame.key, frame.goal, state_, goal_stack_,
+                                { trail_.data() + frame.trail_mark, trail_.data() + trail_.size() },
+                                plan_.data() + frame.plan_mark, plan_.data() + plan_.size(), work);
+  }
+}
+
+/*
+  The iterative engine
+  --------------------
+
+  achieve and apply_op recurse once per level of subgoal, and the
+  lambdas std::any_of and std::all_of call add frames of their own, so
+  a domain whose plans need a chain of ten thousand subgoals runs out
+  of stack long before it runs out of anything else. achieve_iterative
+  does exactly what achieve does, in exactly the same order, with its
+  own stack of Frames in a vector instead.
+
+  A Frame is a goal being pursued: which of its candidates we're on,
+  and which of that candidate's preconditions. The loop takes the top
+  frame and works through its preconditions for as long as each one
+  is settled without searching. When one needs a search of its own,
+  the frame saves where it's up to and a frame for the precondition
+  is pushed. Once every precondition is achieved the candidate is
+  executed and the frame pops; a goal that runs out of candidates
+  pops too, and fails. The result of a popped frame is handed to the
+  frame below it: success moves on to the next precondition, and
+  failure undoes the candidate and moves on to the next one.
+
+  The frames are 40 bytes each and sit next to each other, so walking
+  up and down the stack stays in cache, and the vector is kept between
+  solves. On shallow plans the recursion is still a little faster,
+  since the CPU predicts returns better than it predicts which way
+  the loop will go next, so gps-iterative is for the domains that
+  need it rather than the default.
+*/
+bool Solver::achieve_iterative(Condition goal) {
+  frames_.clear();
+  Frame frame;
+  Opened opened = open_goal(goal, frame);
+  if (opened != Opened::search) {
+    return opened == Opened::achieved;
+  }
+  frames_.push_back(frame);
+  bool result = false;
+  bool returning = false;
+  while (!frames_.empty()) {
+    Frame& top = frames_.back();
+    auto candidates = domain_.candidates(top.goal);
+    std::uint32_t candidate = top.candidate;
+    std::uint32_t precond = top.precond;
+    bool descended = false;
+    for (; candidate < candidates.size(); ++candidate, precond = 0) {
+      OpId op = candidates[candidate];
+      auto preconds = domain_.preconds(op);
+      GPS_STAT(if (precond == 0 && !returning) {
+                 ++stats_.candidates;
+               });
+      if (returning) {
+        returning = false;
+        if (!result) {
+          undo_candidate(top);
+          continue;
+        }
+        ++precond;
+      } else if (track_ && applicable_->applicable(op)) {
+        precond = static_cast<std::uint32_t>(preconds.size());
+      }
+      for (; precond < preconds.size(); ++precond) {
+        opened = open_goal(preconds[precond], frame);
+        if (opened != Opened::achieved) {
+          break;
+        }
+      }
+      if (precond == preconds.size()) {
+        execute(op);
+        break;
+      }
+      if (opened == Opened::search) {
+        top.candidate = candidate;
+        top.precond = precond;
+        descended = true;
+        break;
+      }
+      undo_candidate(top);
+    }
+    if (descended) {
+      frames_.push_back(frame);
+      continue;
+    }
+    result = candidate < candidates.size();
+    close_goal(top, result);
+    frames_.pop_back();
+    returning = true;
+  }
+  return result;
+}
+
+void print_plan(const Domain& domain, const std::vector<OpId>& plan) {
+  for (auto op : plan) {
+    std::printf("Executing operation: %s.\n", domain.action(op));
+  }
+}
+
+/*
+  In practice we don't solve one problem, we solve lots of small ones
+  against the same operators. A Problem is one (initial state, goals)
+  pair, and a SolveResult is what a Solver had to say about it.
+*/
+struct Problem {
+  std::vector<Condition> initial;
+  std::vector<Condition> goals;
+};
+
+struct SolveResult {
+  bool solved = false;
+  std::vector<OpId> plan;
+  SearchStats stats;
+};
+
+/*
+  A small work-stealing scheduler for a fixed batch of independent
+  jobs numbered 0 to n-1. Each worker thread starts with its own
+  contiguous block of job numbers in its own queue and takes jobs from
+  the back. When its queue runs dry it steals from the front of
+  somebody else's. Jobs never create more jobs, so a worker that finds
+  every queue empty can simply stop.
+
+  The queues are locked with a plain mutex. The jobs we run are far
+  more expensive than an uncontended lock, and the lock is only ever
+  contended while stealing.
+*/
+class WorkQueue {
+public:
+  void push(std::size_t job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs_.push_back(job);
+  }
+
+  bool pop(std::size_t& job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (jobs_.empty()) {
+      return false;
+    }
+    job = jobs_.back();
+    jobs_.pop_back();
+    return true;
+  }
+
+  bool steal(std::size_t& job) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (jobs_.empty()) {
+      return false;
+    }
+    job = jobs_.front();
+    jobs_.pop_front();
+    return true;
+  }
+
+private:
+  std::mutex mutex_;
+  std::deque<std::size_t> jobs_;
+};
+
+/*
+  Call work(worker, job) for every job in [0, n_jobs), spread over
+  n_threads threads. The worker number lets work() keep per-thread
+  state, like a Solver, without any locking of its own.
+*/
+template<typename Work>
+void run_work_stealing(std::size_t n_jobs, unsigned n_threads, Work work) {
+  if (n_threads <= 1 || n_jobs <= 1) {
+    for (std::size_t job = 0; job < n_jobs; ++job) {
+      work(0u, job);
+    }
+    return;
+  }
+
+  std::vector<WorkQueue> queues(n_threads);
+  for (std::size_t job = 0; job < n_jobs; ++job) {
+    queues[job * n_threads / n_jobs].push(job);
+  }
+
+  auto worker = [&](unsigned self) {
+    std::size_t job;
+    for (;;) {
+      if (queues[self].pop(job)) {
+        work(self, job);
+        continue;
+      }
+      bool stolen = false;
+      for (unsigned k = 1; k < n_threads && !stolen; ++k) {
+        stolen = queues[(self + k) % n_threads].steal(job);
+      }
+      if (!stolen) {
+        return;
+      }
+      work(self, job);
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (unsigned t = 1; t < n_threads; ++t) {
+    threads.emplace_back(worker, t);
+  }
+  worker(0);
+  for (auto& t : threads) {
+    t.join();
+  }
+}
+
+/*
+  Solve every problem against one shared Domain. Each worker thread
+  gets a Solver of its own; the Domain is only ever read. Results come
+  back in the same order as the problems, however the jobs were
+  scheduled. A thread count of zero means one per hardware thread.
+*/
+std::vector<SolveResult> solve_batch(const Domain& domain,
+                                     const std::vector<Problem>& problems,
+                                     unsigned n_threads = 0,
+                                     const SolveOptions& options = SolveOptions{}) {
+  if (n_threads == 0) {
+    n_threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+  std::vector<SolveResult> results(problems.size());
+  std::vector<Solver> solvers;
+  solvers.reserve(n_threads);
+  for (unsigned t = 0; t < n_threads; ++t) {
+    solvers.emplace_back(domain);
+  }
+
+  run_work_stealing(problems.size(), n_threads, [&](unsigned worker, std::size_t i) {
+    Solver& solver = solvers[worker];
+    results[i].solved = solver.solve(problems[i].initial, problems[i].goals, options);
+    results[i].plan = solver.plan();
+    results[i].stats = solver.stats();
+  });
+  return results;
+}
+
+/*
+  Domain files
+  ------------
+
+  Domains and problems are written in a plain text format that is
+  read a line at a time. Each line starts with a keyword, followed by
+  names separated by spaces or tabs. A word starting with # comments
+  out the rest of its line, and blank lines are ignored.
+
+    op <action>            start a new operator
+    pre <condition> ...    preconditions of the most recent op
+    add <condition> ...    its add list
+    del <condition> ...    its delete list
+    init <condition> ...   the conditions that hold at the start of a problem
+    goal <condition> ...   the goals of that problem
+
+  pre, add and del lines may come in any order, may be repeated (the
+  conditions accumulate) and may be left out when the list is empty.
+  A problem is an init line followed by a goal line. A name is any run
+  of non-blank characters, and a condition exists as soon as a line
+  mentions it. domains/school.gps is the example from the start of
+  PAIP chapter 4 written out this way; gps has its own copy built in,
+  and that's what it solves when it isn't told to do anything else.
+
+  A Token is a word of the file, pointing into the file's own text.
+  The Tokenizer makes one pass over the text and never copies it; the
+  only allocations while loading are the ones that build the Domain.
+*/
+struct Token {
+  const char* text = nullptr;
+  std::size_t length = 0;
+
+  bool is(const char* keyword) const {
+    std::size_t n = std::char_traits<char>::length(keyword);
+    return n == length && std::equal(text, text + length, keyword);
+  }
+};
+
+class Tokenizer {
+public:
+  Tokenizer(const char* first, const char* last) : p_ { first }, end_ { last } { }
+
+  /*
+    Move to the next line that has anything on it, skipping whatever
+    was left of the current one, and read its first word.
+  */
+  bool next_line(Token& keyword) {
+    for (;;) {
+      if (!at_line_start_) {
+        while (p_ != end_ && *p_ != '\n') {
+          ++p_;
+        }
+        if (p_ == end_) {
+          return false;
+        }
+        ++p_;
+      }
+      at_line_start_ = false;
+      ++line_;
+      if (next_word(keyword)) {
+        return true;
+      }
+    }
+  }
+
+  // Read the next word on the current line, if there is one.
+  bool next_word(Token& word) {
+    while (p_ != end_ && (*p_ == ' ' || *p_ == '\t' || *p_ == '\r')) {
+      ++p_;
+    }
+    if (p_ == end_ || *p_ == '\n' || *p_ == '#') {
+      return false;
+    }
+    const char* first = p_;
+    while (p_ != end_ && *p_ != ' ' && *p_ != '\t' && *p_ != '\r' && *p_ != '\n') {
+      ++p_;
+    }
+    word.text = first;
+    word.length = static_cast<std::size_t>(p_ - first);
+    return true;
+  }
+
+  std::size_t line() const { return line_; }
+
+private:
+  const char* p_;
+  const char* end_;
+  std::size_t line_ = 0;
+  bool at_line_start_ = true;
+};
+
+/*
+  Parse domain text into operators and problems. resolve(token, c)
+  turns a name into a Condition: when loading a domain it interns the
+  name, and when reading problems for a Domain that already exists it
+  looks the name up and fails if it isn't there. Passing ops as null
+  means operators aren't allowed in this text.
+
+  Errors are reported on stderr as source:line: message, and the
+  parse stops at the first one.
+*/
+template<typename Resolve>
+bool parse_domain_text(const char* first, const char* last, const char* source,
+                       Resolve resolve, std::vector<Op>* ops, std::vector<Problem>& problems) {
+  Tokenizer in(first, last);
+  Token keyword, word;
+  std::string action;
+  std::vector<Condition> preconds, add_list, del_list;
+  bool have_op = false;
+  bool have_init = false;
+  Problem problem;
+
+  auto fail = [&](const char* message) {
+    std::fprintf(stderr, "%s:%zu: %s\n", source, in.line(), message);
+    return false;
+  };
+  auto read_conditions = [&](std::vector<Condition>& into) {
+    while (in.next_word(word)) {
+      Condition c;
+      if (!resolve(word, c)) {
+        std::fprintf(stderr, "%s:%zu: unknown condition '%.*s'\n",
+                     source, in.line(), static_cast<int>(word.length), word.text);
+        return false;
+      }
+      into.push_back(c);
+    }
+    return true;
+  };
+  auto finish_op = [&]() {
+    if (have_op) {
+      ops->emplace_back(action, preconds, add_list, del_list);
+      preconds.clear();
+      add_list.clear();
+      del_list.clear();
+      have_op = false;
+    }
+  };
+
+  while (in.next_line(keyword)) {
+    if (keyword.is("op")) {
+      if (ops == nullptr) {
+        return fail("operators aren't allowed here");
+      }
+      if (have_init) {
+        return fail("init without a goal");
+      }
+      finish_op();
+      if (!in.next_word(word)) {
+        return fail("op needs an action name");
+      }
+      action.assign(word.text, word.length);
+      if (in.next_word(word)) {
+        return fail("op takes exactly one action name");
+      }
+      have_op = true;
+    } else if (keyword.is("pre") || keyword.is("add") || keyword.is("del")) {
+      if (!have_op) {
+        return fail("pre, add and del must follow an op");
+      }
+      auto& into = keyword.is("pre") ? preconds : keyword.is("add") ? add_list : del_list;
+      if (!read_conditions(into)) {
+        return false;
+      }
+    } else if (keyword.is("init")) {
+      if (have_init) {
+        return fail("init without a goal");
+      }
+      finish_op();
+      if (!read_conditions(problem.initial)) {
+        return false;
+      }
+      have_init = true;
+    } else if (keyword.is("goal")) {
+      if (!have_init) {
+        return fail("goal without an init");
+      }
+      if (!read_conditions(problem.goals)) {
+        return false;
+      }
+      problems.push_back(std::move(problem));
+      problem = Problem{};
+      have_init = false;
+    } else {
+      std::fprintf(stderr, "%s:%zu: unknown keyword '%.*s'\n",
+                   source, in.line(), static_cast<int>(keyword.length), keyword.text);
+      return false;
+    }
+  }
+  if (have_init) {
+    return fail("init without a goal");
+  }
+  finish_op();
+  return true;
+}
+
+/*
+  Read all of a stream into memory. The loader wants the whole text in
+  one block so that tokens can point straight into it.
+*/
+bool read_all(std::FILE* in, std::string& text) {
+  char buffer[1 << 16];
+  std::size_t n;
+  while ((n = std::fread(buffer, 1, sizeof buffer, in)) > 0) {
+    text.append(buffer, n);
+  }
+  return !std::ferror(in);
+}
+
+bool read_file(const char* path, std::string& text) {
+  std::FILE* in = std::fopen(path, "rb");
+  if (in == nullptr) {
+    std::fprintf(stderr, "%s: can't open\n", path);
+    return false;
+  }
+  if (std::fseek(in, 0, SEEK_END) == 0) {
+    long size = std::ftell(in);
+    if (size > 0) {
+      text.reserve(static_cast<std::size_t>(size));
+    }
+    std::rewind(in);
+  }
+  bool ok = read_all(in, text);
+  std::fclose(in);
+  if (!ok) {
+    std::fprintf(stderr, "%s: read error\n", path);
+  }
+  return ok;
+}
+
+/*
+  A quick upper bound on the number of operators in some domain text,
+  so the operator table can be allocated once: every op starts a line
+  with the keyword op and a blank. Only a malformed line can make this
+  an overestimate, and nothing can make it an under.
+*/
+std::size_t count_ops(const char* first, const char* last) {
+  std::size_t n = 0;
+  while (first < last) {
+    while (first < last && (*first == ' ' || *first == '\t')) {
+      ++first;
+    }
+    n += last - first > 2 && first[0] == 'o' && first[1] == 'p' && (first[2] == ' ' || first[2] == '\t');
+    const void* newline = std::memchr(first, '\n', static_cast<std::size_t>(last - first));
+    first = newline != nullptr ? static_cast<const char*>(newline) + 1 : last;
+  }
+  return n;
+}
+
+bool is_snapshot(const char* path) {
+  char magic[sizeof domain_magic] = {};
+  std::FILE* in = std::fopen(path, "rb");
+  if (in == nullptr) {
+    return false;
+  }
+  bool match = std::fread(magic, 1, sizeof magic, in) == sizeof magic &&
+               std::equal(std::begin(magic), std::end(magic), domain_magic);
+  std::fclose(in);
+  return match;
+}
+
+/*
+  Build a Domain from domain text in memory: intern every name it
+  mentions, collect its operators into a Domain, and hand back any
+  problems it contains. source names the text in error messages.
+  Returns null, after saying why on stderr, if it can't be parsed.
+*/
+std::unique_ptr<Domain> parse_domain(const char* first, const char* last, const char* source,
+                                     std::vector<Problem>& problems) {
+  SymbolTable symbols;
+  std::vector<Op> ops;
+  ops.reserve(count_ops(first, last));
+  auto intern = [&symbols](const Token& t, Condition& c) {
+    c = symbols.intern(t.text, t.length);
+    return true;
+  };
+  if (!parse_domain_text(first, last, source, intern, &ops, problems)) {
+    return nullptr;
+  }
+  return std::unique_ptr<Domain>(new Domain(symbols, ops));
+}
+
+/*
+  Load a domain file, the same way. Returns null, after saying why on
+  stderr, if the file can't be read or parsed.
+
+  A snapshot written by gps --compile is mapped instead of parsed.
+  Snapshots hold only the domain, never problems.
+*/
+std::unique_ptr<Domain> load_domain(const char* path, std::vector<Problem>& problems) {
+  if (is_snapshot(path)) {
+    return Domain::map(path);
+  }
+  std::string text;
+  if (!read_file(path, text)) {
+    return nullptr;
+  }
+  return parse_domain(text.data(), text.data() + text.size(), path, problems);
+}
+
+/*
+  Parse problems for an existing Domain, in the same format. Every
+  name has to be a condition the domain already knows about.
+*/
+bool parse_problems(const char* first, const char* last, const char* source, const Domain& domain,
+                    std::vector<Problem>& problems) {
+  auto lookup = [&domain](const Token& t, Condition& c) {
+    return domain.lookup(t.text, t.length, c);
+  };
+  return parse_domain_text(first, last, source, lookup, nullptr, problems);
+}
+
+// The same, read from a file.
+bool read_problems(std::FILE* in, const char* source, const Domain& domain,
+                   std::vector<Problem>& problems) {
+  std::string text;
+  if (!read_all(in, text)) {
+    std::fprintf(stderr, "%s: read error\n", source);
+    return false;
+  }
+  return parse_problems(text.data(), text.data() + text.size(), source, domain, problems);
+}
+
+/*
+  The school domain from the start of PAIP chapter 4, and its four
+  example problems, built in so that gps needs no files to run: it's
+  what gps solves when it isn't given a domain, and what gps --batch
+  and gps --bench plan with. domains/school.gps has the same ops and
+  problems as a file, and make check checks that the two agree.
+*/
+const char school_ops[] = R"(op drive-son-to-school
+pre son-at-home car-works
+add son-at-school
+del son-at-home
+
+op shop-installs-battery
+pre car-needs-battery shop-knows-problem shop-has-money
+add car-works
+
+op tell-shop-problem
+pre in-communication-with-shop
+add shop-knows-problem
+
+op telephone-shop
+pre know-phone-number
+add in-communication-with-shop
+
+op look-up-number
+pre have-phone-book
+add know-phone-number
+
+op give-shop-money
+pre have-money
+add shop-has-money
+del have-money
+)";
+
+const char school_problems[] = R"(init son-at-home car-needs-battery have-money have-phone-book
+goal son-at-school
+
+init son-at-home car-works
+goal son-at-school
+
+init son-at-home
+goal son-at-school
+
+init son-at-home car-needs-battery have-money
+goal son-at-school
+)";
+
+std::unique_ptr<Domain> school_domain() {
+  std::vector<Problem> none;
+  return parse_domain(school_ops, school_ops + sizeof school_ops - 1, "<school>", none);
+}
+
+/*
+  --stats asks for the search statistics of every solve, written to
+  stderr as one JSON object per line. They only exist if the program
+  was built with -DGPS_STATS, so say so rather than print zeros.
+*/
+bool stats_available() {
+  if (!stats_enabled) {
+    std::fprintf(stderr, "--stats needs a build with -DGPS_STATS\n");
+  }
+  return stats_enabled;
+}
+
+/*
+  Synthetic domains
+  -----------------
+
+  The school domain has six operators, which tells us nothing about
+  how the solver scales. gps --generate writes bigger domains, with
+  problems, in the domain file format, so every engine can be run on
+  the same inputs:
+
+    random    conditions and operators wired together at random
+    layered   conditions in layers; an operator adds a condition of
+              its layer and needs conditions from the layer below, so
+              plans are chains about --depth long. --cycles is the
+              chance that a precondition comes from the same or a
+              higher layer instead, which makes goal cycles.
+    blocks    PAIP's blocks world with --size blocks
+    monkey    PAIP's monkey and bananas, with the bananas --size rooms
+              down a corridor from the door
+    maze      a random --size by --size maze; PAIP's is 5 by 5
+    mazes     --count of those mazes, of which each problem only
+              needs one
+
+  The same seed always gives the same output.
+*/
+struct GeneratorOptions {
+  std::string kind;
+  std::uint64_t seed = 1;
+  std::size_t conditions = 1000;
+  std::size_t ops = 5000;
+  std::size_t depth = 10;
+  std::size_t branching = 3;
+  double del_density = 0.1;
+  double cycles = 0.0;
+  std::size_t size = 5;
+  std::size_t problems = 10;
+  std::size_t count = 10;
+};
+
+/*
+  Writes one operator or problem line at a time. Names are built with
+  printf-style formats, so a line like "pre c1 c7" is
+  line("pre").name("c%zu", 1).name("c%zu", 7).
+*/
+class DomainWriter {
+public:
+  explicit DomainWriter(std::FILE* out) : out_ { out } { }
+
+  DomainWriter& line(const char* keyword) {
+    if (started_) {
+      std::fputc('\n', out_);
+    }
+    std::fputs(keyword, out_);
+    started_ = true;
+    return *this;
+  }
+
+  template<typename... Args>
+  DomainWriter& name(const char* format, Args... args) {
+    std::fputc(' ', out_);
+    std::fprintf(out_, format, args...);
+    return *this;
+  }
+
+  void blank() { std::fputc('\n', out_); }
+
+  ~DomainWriter() {
+    if (started_) {
+      std::fputc('\n', out_);
+    }
+  }
+
+private:
+  std::FILE* out_;
+  bool started_ = false;
+};
+
+void generate_random(const GeneratorOptions& o, std::mt19937_64& rng, DomainWriter& w) {
+  std::uniform_int_distribution<std::size_t> any(0, o.conditions - 1);
+  std::uniform_int_distribution<std::size_t> n_pre(0, o.branching);
+  std::uniform_int_distribution<std::size_t> n_add(1, 2);
+  std::bernoulli_distribution deletes(o.del_density);
+  for (std::size_t i = 0; i < o.ops; ++i) {
+    w.line("op").name("op%zu", i);
+    w.line("pre");
+    for (std::size_t k = n_pre(rng); k > 0; --k) {
+      w.name("c%zu", any(rng));
+    }
+    w.line("add");
+    for (std::size_t k = n_add(rng); k > 0; --k) {
+      w.name("c%zu", any(rng));
+    }
+    if (deletes(rng)) {
+      w.line("del").name("c%zu", any(rng));
+    }
+  }
+  for (std::size_t p = 0; p < o.problems; ++p) {
+    w.line("init");
+    for (std::size_t k = o.conditions / 10; k > 0; --k) {
+      w.name("c%zu", any(rng));
+    }
+    w.line("goal").name("c%zu", any(rng)).name("c%zu", any(rng));
+  }
+}
+
+void generate_layered(const GeneratorOptions& o, std::mt19937_64& rng, DomainWriter& w) {
+  std::size_t depth = std::max<std::size_t>(o.depth, 1);
+  std::size_t width = std::max<std::size_t>(o.conditions / (depth + 1), 1);
+  std::uniform_int_distribution<std::size_t> in_layer(0, width - 1);
+  std::uniform_int_distribution<std::size_t> any_layer(0, depth);
+  std::bernoulli_distribution deletes(o.del_density);
+  std::bernoulli_distribution back_edge(o.cycles);
+  for (std::size_t i = 0; i < o.ops; ++i) {
+    std::size_t layer = 1 + i % depth;
+    w.line("op").name("op%zu", i);
+    w.line("pre");
+    for (std::size_t k = 0; k < o.branching; ++k) {
+      std::size_t from = back_edge(rng) ? std::max(layer, any_layer(rng)) : layer - 1;
+      w.name("l%zu-c%zu", from, in_layer(rng));
+    }
+    w.line("add").name("l%zu-c%zu", layer, in_layer(rng));
+    if (deletes(rng)) {
+      w.line("del").name("l%zu-c%zu", layer - 1, in_layer(rng));
+    }
+  }
+  for (std::size_t p = 0; p < o.problems; ++p) {
+    w.line("init");
+    for (std::size_t c = 0; c < width; ++c) {
+      w.name("l0-c%zu", c);
+    }
+    w.line("goal").name("l%zu-c%zu", depth, in_layer(rng));
+  }
+}
+
+/*
+  The blocks world, as in PAIP section 4.13. Blocks are b0, b1, ...
+  and "move-b0-from-b1-to-table" moves b0 off of b1 onto the table.
+  Each problem starts from random towers and asks for other random
+  towers.
+*/
+void generate_blocks(const GeneratorOptions& o, std::mt19937_64& rng, DomainWriter& w) {
+  const std::size_t n = std::max<std::size_t>(o.size, 2);
+  const std::size_t table = n;
+  auto place = [&](std::size_t b) { return b == table ? std::string("table") : "b" + std::to_string(b); };
+  auto move_op = [&](std::size_t a, std::size_t b, std::size_t c) {
+    std::string A = place(a), B = place(b), C = place(c);
+    w.line("op").name("move-%s-from-%s-to-%s", A.c_str(), B.c_str(), C.c_str());
+    w.line("pre").name("space-on-%s", A.c_str()).name("%s-on-%s", A.c_str(), B.c_str());
+    if (c != table) {
+      w.name("space-on-%s", C.c_str());
+    }
+    w.line("add").name("%s-on-%s", A.c_str(), C.c_str());
+    if (b != table) {
+      w.name("space-on-%s", B.c_str());
+    }
+    w.line("del").name("%s-on-%s", A.c_str(), B.c_str());
+    if (c != table) {
+      w.name("space-on-%s", C.c_str());
+    }
+  };
+  for (std::size_t a = 0; a < n; ++a) {
+    for (std::size_t b = 0; b < n; ++b) {
+      if (a == b) {
+        continue;
+      }
+      for (std::size_t c = 0; c < n; ++c) {
+        if (c != a && c != b) {
+          move_op(a, b, c);
+        }
+      }
+      move_op(a, table, b);
+      move_op(a, b, table);
+    }
+  }
+
+  // Random towers: shuffle the blocks, then cut the order into stacks.
+  auto towers = [&](bool with_space) {
+    std::vector<std::size_t> order(n);
+    for (std::size_t i = 0; i < n; ++i) {
+      order[i] = i;
+    }
+    std::shuffle(std::begin(order), std::end(order), rng);
+    std::bernoulli_distribution new_tower(0.3);
+    std::size_t below = table;
+    for (std::size_t i = 0; i < n; ++i) {
+      if (i > 0 && new_tower(rng)) {
+        if (with_space) {
+          w.name("space-on-%s", place(order[i - 1]).c_str());
+        }
+        below = table;
+      }
+      w.name("%s-on-%s", place(order[i]).c_str(), place(below).c_str());
+      below = order[i];
+    }
+    if (with_space) {
+      w.name("space-on-%s", place(order[n - 1]).c_str());
+    }
+  };
+  for (std::size_t p = 0; p < o.problems; ++p) {
+    w.line("init");
+    towers(true);
+    w.line("goal");
+    towers(false);
+  }
+}
+
+/*
+  Monkey and bananas, from PAIP section 4.14, stretched out: rooms r0
+  to r<size> are in a row, the monkey and the chair start in r0 by the
+  door, and the bananas hang in the last room.
+*/
+void generate_monkey(const GeneratorOptions& o, std::mt19937_64&, DomainWriter& w) {
+  const std::size_t last = std::max<std::size_t>(o.size, 1);
+  for (std::size_t r = 0; r <= last; ++r) {
+    for (std::size_t s = (r == 0 ? 0 : r - 1); s <= std::min(r + 1, last); ++s) {
+      if (s == r) {
+        continue;
+      }
+      w.line("op").name("walk-from-r%zu-to-r%zu", r, s);
+      w.line("pre").name("at-r%zu", r).name("on-floor");
+      w.line("add").name("at-r%zu", s);
+      w.line("del").name("at-r%zu", r);
+      w.line("op").name("push-chair-from-r%zu-to-r%zu", r, s);
+      w.line("pre").name("chair-at-r%zu", r).name("at-r%zu", r);
+      w.line("add").name("chair-at-r%zu", s).name("at-r%zu", s);
+      w.line("del").name("chair-at-r%zu", r).name("at-r%zu", r);
+    }
+    w.line("op").name("climb-on-chair-at-r%zu", r);
+    w.line("pre").name("chair-at-r%zu", r).name("at-r%zu", r).name("on-floor");
+    w.line("add").name("on-chair-at-r%zu", r);
+    w.line("del").name("at-r%zu", r).name("on-floor");
+  }
+  w.line("op").name("grasp-bananas");
+  w.line("pre").name("on-chair-at-r%zu", last).name("empty-handed");
+  w.line("add").name("has-bananas");
+  w.line("del").name("empty-handed");
+  w.line("op").name("drop-ball");
+  w.line("pre").name("has-ball");
+  w.line("add").name("empty-handed");
+  w.line("del").name("has-ball");
+  w.line("op").name("eat-bananas");
+  w.line("pre").name("has-bananas");
+  w.line("add").name("empty-handed").name("not-hungry");
+  w.line("del").name("has-bananas").name("hungry");
+  for (std::size_t p = 0; p < o.problems; ++p) {
+    w.line("init").name("at-r0").name("chair-at-r0").name("on-floor").name("has-ball").name("hungry");
+    w.line("goal").name("not-hungry");
+  }
+}
+
+/*
+  A maze, as in PAIP section 4.15: cells are numbered row by row, and
+  there are operators to move both ways through every open wall. The
+  walls are knocked down by a randomized depth-first search, so there
+  is exactly one path between any two cells. Problems ask to get from
+  one random cell to another.
+
+  carve_maze does the knocking down, for an n by n maze, and calls
+  move(a, b) and move(b, a) for every wall it opens between a and b.
+*/
+template<typename Move>
+void carve_maze(std::size_t n, std::mt19937_64& rng, Move move) {
+  const std::size_t cells = n * n;
+  std::vector<bool> seen(cells, false);
+  std::vector<std::size_t> stack{0};
+  seen[0] = true;
+  while (!stack.empty()) {
+    std::size_t cell = stack.back();
+    std::size_t row = cell / n, col = cell % n;
+    std::size_t next[4];
+    std::size_t k = 0;
+    if (row > 0 && !seen[cell - n]) next[k++] = cell - n;
+    if (row + 1 < n && !seen[cell + n]) next[k++] = cell + n;
+    if (col > 0 && !seen[cell - 1]) next[k++] = cell - 1;
+    if (col + 1 < n && !seen[cell + 1]) next[k++] = cell + 1;
+    if (k == 0) {
+      stack.pop_back();
+      continue;
+    }
+    std::size_t to = next[std::uniform_int_distribution<std::size_t>(0, k - 1)(rng)];
+    move(cell, to);
+    move(to, cell);
+    seen[to] = true;
+    stack.push_back(to);
+  }
+}
+
+void generate_maze(const GeneratorOptions& o, std::mt19937_64& rng, DomainWriter& w) {
+  const std::size_t n = std::max<std::size_t>(o.size, 2);
+  carve_maze(n, rng, [&](std::size_t a, std::size_t b) {
+    w.line("op").name("move-from-%zu-to-%zu", a, b);
+    w.line("pre").name("at-%zu", a);
+    w.line("add").name("at-%zu", b);
+    w.line("del").name("at-%zu", a);
+  });
+  std::uniform_int_distribution<std::size_t> any(0, n * n - 1);
+  for (std::size_t p = 0; p < o.problems; ++p) {
+    w.line("init").name("at-%zu", any(rng));
+    w.line("goal").name("at-%zu", any(rng));
+  }
+}
+
+/*
+  --count separate mazes, each with a token of its own somewhere in
+  it. A problem puts every token somewhere and asks for one of them to
+  be moved, so most operators can be applied but only the ones in that
+  token's maze are any use: the shape of a big domain where each query
+  only concerns a small part of it.
+*/
+void generate_mazes(const GeneratorOptions& o, std::mt19937_64& rng, DomainWriter& w) {
+  const std::size_t n = std::max<std::size_t>(o.size, 2);
+  const std::size_t count = std::max<std::size_t>(o.count, 1);
+  for (std::size_t m = 0; m < count; ++m) {
+    carve_maze(n, rng, [&](std::size_t a, std::size_t b) {
+      w.line("op").name("move-m%zu-from-%zu-to-%zu", m, a, b);
+      w.line("pre").name("m%zu-at-%zu", m, a);
+      w.line("add").name("m%zu-at-%zu", m, b);
+      w.line("del").name("m%zu-at-%zu", m, a);
+    });
+  }
+  std::uniform_int_distribution<std::size_t> any(0, n * n - 1);
+  std::uniform_int_distribution<std::size_t> any_maze(0, count - 1);
+  for (std::size_t p = 0; p < o.problems; ++p) {
+    w.line("init");
+    for (std::size_t m = 0; m < count; ++m) {
+      w.name("m%zu-at-%zu", m, any(rng));
+    }
+    w.line("goal").name("m%zu-at-%zu", any_maze(rng), any(rng));
+  }
+}
+
+bool generate_domain(const GeneratorOptions& o, std::FILE* out) {
+  std::mt19937_64 rng(o.seed);
+  DomainWriter w(out);
+  if (o.kind == "random") {
+    generate_random(o, rng, w);
+  } else if (o.kind == "layered") {
+    generate_layered(o, rng, w);
+  } else if (o.kind == "blocks") {
+    generate_blocks(o, rng, w);
+  } else if (o.kind == "monkey") {
+    generate_monkey(o, rng, w);
+  } else if (o.kind == "maze") {
+    generate_maze(o, rng, w);
+  } else if (o.kind == "mazes") {
+    generate_mazes(o, rng, w);
+  } else {
+    std::fprintf(stderr, "unknown domain kind '%s'\n", o.kind.c_str());
+    return false;
+  }
+  return true;
+}
+
+/*
+  A probability: a number from 0 to 1, and nothing after it.
+*/
+bool parse_probability(const char* value, double& p) {
+  char* end = nullptr;
+  p = std::strtod(value, &end);
+  return end != value && *end == '\0' && p >= 0 && p <= 1;
+}
+
+/*
+  A count: a whole number, in decimal, that fits in n, and nothing
+  after it. strtoull on its own would take "-1", " 12" and "12x".
+*/
+template<typename Count>
+bool parse_count(const char* value, Count& n) {
+  if (*value < '0' || *value > '9') {
+    return false;
+  }
+  errno = 0;
+  char* end = nullptr;
+  unsigned long long v = std::strtoull(value, &end, 10);
+  if (errno == ERANGE || *end != '\0' || static_cast<unsigned long long>(static_cast<Count>(v)) != v) {
+    return false;
+  }
+  n = static_cast<Count>(v);
+  return true;
+}
+
+/*
+  gps --generate KIND [--seed N] [--conditions N] [--ops N] [--depth N]
+                      [--branching N] [--del-density P] [--cycles P]
+                      [--size N] [--problems N] [--count N]
+
+  Writes the domain to stdout. --del-density and --cycles are
+  probabilities, and --cycles only means something for layered; the
+  rest are whole numbers.
+*/
+int run_generate(int argc, char **argv) {
+  if (argc < 3) {
+    std::fprintf(stderr, "usage: gps --generate random|layered|blocks|monkey|maze|mazes [options]\n");
+    return 2;
+  }
+  GeneratorOptions o;
+  o.kind = argv[2];
+  for (int i = 3; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      std::fprintf(stderr, "missing value for '%s'\n", arg.c_str());
+      return 2;
+    }
+    const char* value = argv[++i];
+    bool counted = true;
+    if (arg == "--seed") {
+      counted = parse_count(value, o.seed);
+    } else if (arg == "--conditions") {
+      counted = parse_count(value, o.conditions);
+      o.conditions = std::max<std::size_t>(1, o.conditions);
+    } else if (arg == "--ops") {
+      counted = parse_count(value, o.ops);
+    } else if (arg == "--depth") {
+      counted = parse_count(value, o.depth);
+    } else if (arg == "--branching") {
+      counted = parse_count(value, o.branching);
+    } else if (arg == "--del-density" || arg == "--cycles") {
+      double& p = arg == "--cycles" ? o.cycles : o.del_density;
+      if (!parse_probability(value, p)) {
+        std::fprintf(stderr, "%s must be a number from 0 to 1, not '%s'\n", arg.c_str(), value);
+        return 2;
+      }
+      if (arg == "--cycles" && o.kind != "layered") {
+        std::fprintf(stderr, "--cycles only applies to layered domains\n");
+        return 2;
+      }
+    } else if (arg == "--size") {
+      counted = parse_count(value, o.size);
+    } else if (arg == "--problems") {
+      counted = parse_count(value, o.problems);
+    } else if (arg == "--count") {
+      counted = parse_count(value, o.count);
+    } else {
+      std::fprintf(stderr, "unknown argument '%s'\n", arg.c_str());
+      return 2;
+    }
+    if (!counted) {
+      std::fprintf(stderr, "%s must be a whole number, not '%s'\n", arg.c_str(), value);
+      return 2;
+    }
+  }
+  return generate_domain(o, stdout) ? 0 : 1;
+}
+
+/*
+  gps --compile FILE SNAPSHOT
+
+  Load the text domain in FILE and save it, compiled, as SNAPSHOT. Any
+  problems in FILE are left out. --domain accepts a snapshot anywhere
+  it accepts a text file, and maps it rather than parsing it.
+*/
+int run_compile(int argc, char **argv) {
+  if (argc != 4) {
+    std::fprintf(stderr, "usage: gps --compile FILE SNAPSHOT\n");
+    return 2;
+  }
+  std::vector<Problem> problems;
+  auto domain = load_domain(argv[2], problems);
+  if (!domain) {
+    return 1;
+  }
+  return domain->save(argv[3]) ? 0 : 1;
+}
+
+/*
+  gps --batch [--domain FILE] [--threads N] [--stats]
+              [--engine gps|gps-iterative|astar|gbfs]
+              [--heuristic blind|goal-count|max|add|ff] [--max-nodes N]
+              [--track-applicable] [--all-ops] [< problems]
+
+  Solves problems against the operators in FILE, or the built-in
+  school domain's if there's no --domain. The problems are the ones
+  in FILE, if it has any, and otherwise are read from stdin in the
+  domain file format (init and goal lines only); without --domain
+  they always come from stdin. --engine picks the planner (gps, the
+  means-ends analysis, by default; gps-iterative is the same without
+  recursion, for very deep plans) and --heuristic and --max-nodes
+  tune the best-first ones. --track-applicable keeps the set of
+  applicable operators up to date incrementally, and --all-ops has
+  forward search consider irrelevant operators too; see SolveOptions.
+
+  Prints one line per problem, in input order: its number, SOLVED or
+  FAILED, and the actions that were executed.
+*/
+int run_batch(int argc, char **argv) {
+  unsigned n_threads = 0;
+  bool want_stats = false;
+  const char* domain_path = nullptr;
+  SolveOptions options;
+  for (int i = 2; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--domain" && i + 1 < argc) {
+      domain_path = argv[++i];
+    } else if (arg == "--engine" && i + 1 < argc) {
+      if (!parse_engine(argv[++i], options.engine)) {
+        std::fprintf(stderr, "unknown engine '%s'\n", argv[i]);
+        return 2;
+      }
+    } else if (arg == "--heuristic" && i + 1 < argc) {
+      if (!parse_heuristic(argv[++i], options.heuristic)) {
+        std::fprintf(stderr, "unknown heuristic '%s'\n", argv[i]);
+        return 2;
+      }
+    } else if (arg == "--max-nodes" && i + 1 < argc) {
+      options.max_nodes = std::strtoull(argv[++i], nullptr, 10);
+    } else if (arg == "--track-applicable") {
+      options.track_applicable = true;
+    } else if (arg == "--all-ops") {
+      options.relevant_only = false;
+    } else if (arg == "--threads" && i + 1 < argc) {
+      n_threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--stats") {
+      if (!stats_available()) {
+        return 2;
+      }
+      want_stats = true;
+    } else {
+      std::fprintf(stderr, "unknown argument '%s'\n", arg.c_str());
+      return 2;
+    }
+  }
+
+  std::vector<Problem> problems;
+  auto loaded = domain_path != nullptr ? load_domain(domain_path, problems) : school_domain();
+  if (!loaded) {
+    return 1;
+  }
+  const Domain& domain = *loaded;
+  if (problems.empty() && !read_problems(stdin, "<stdin>", domain, problems)) {
+    return 1;
+  }
+  auto results = solve_batch(domain, problems, n_threads, options);
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    std::printf("%zu %s", i, results[i].solved ? "SOLVED" : "FAILED");
+    for (auto op : results[i].plan) {
+      std::printf(" %s", domain.action(op));
+    }
+    std::printf("\n");
+    if (want_stats) {
+      write_json(stderr, results[i].stats);
+    }
+  }
+  return 0;
+}
+
+
+/*
+  gps --bench-find-all [n_ops]
+
+  Times find_all over a large randomly generated operator table, once
+  through the std::function version and once through the template
+  version, with the same predicate and the same goals. Both results,
+  and the results of complementing either predicate, are checked
+  against each other op for op, and any difference exits with 1.
+*/
+int run_find_all_bench(int argc, char **argv) {
+  std::size_t n_ops = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 100000;
+  const std::size_t n_conditions = std::max<std::size_t>(n_ops / 4, 1);
+  const std::size_t n_goals = 64;
+
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<Condition> any_condition(0, static_cast<Condition>(n_conditions - 1));
+  std::vector<Op> ops;
+  ops.reserve(n_ops);
+  for (std::size_t i = 0; i < n_ops; ++i) {
+    ops.emplace_back("op-" + std::to_string(i),
+                     std::vector<Condition>{any_condition(rng), any_condition(rng)},
+                     std::vector<Condition>{any_condition(rng), any_condition(rng)},
+                     std::vector<Condition>{any_condition(rng)});
+  }
+  std::vector<Condition> goals;
+  for (std::size_t i = 0; i < n_goals; ++i) {
+    goals.push_back(any_condition(rng));
+  }
+
+  auto time_ns_per_op = [&](std::function<std::size_t(Condition)> one_goal, std::size_t& found) {
+    auto start = std::chrono::steady_clock::now();
+    found = 0;
+    for (auto goal : goals) {
+      found += one_goal(goal);
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (n_goals * n_ops);
+  };
+
+  std::size_t found_erased = 0, found_template = 0;
+  double erased = time_ns_per_op([&](Condition goal) {
+    std::function<bool(Condition, const Op&)> pred = appropriate_p;
+    return find_all(goal, ops, pred).size();
+  }, found_erased);
+  double templated = time_ns_per_op([&](Condition goal) {
+    return find_all(goal, ops, [](Condition g, const Op& op) { return appropriate_p(g, op); }).size();
+  }, found_template);
+
+  std::printf("find_all over %zu ops, %zu goals\n", n_ops, n_goals);
+  std::printf("  std::function predicate: %.3f ns/op\n", erased);
+  std::printf("  template predicate:      %.3f ns/op\n", templated);
+  if (found_erased != found_template) {
+    std::fprintf(stderr, "mismatch: %zu vs %zu matches\n", found_erased, found_template);
+    return 1;
+  }
+
+  // The same number of matches could still be different ops, so
+  // compare the lists themselves, and the complement of the predicate.
+  std::function<bool(Condition, const Op&)> erased_pred = appropriate_p;
+  auto templated_pred = [](Condition g, const Op& op) { return appropriate_p(g, op); };
+  for (auto goal : goals) {
+    auto want = find_all(goal, ops, erased_pred);
+    if (find_all(goal, ops, templated_pred) != want) {
+      std::fprintf(stderr, "mismatch: different ops add condition %u\n", goal);
+      return 1;
+    }
+    auto rest = find_all(goal, ops, complement(templated_pred));
+    if (want.size() + rest.size() != ops.size() || find_all(goal, ops, complement(erased_pred)) != rest) {
+      std::fprintf(stderr, "mismatch: complement of the predicate for condition %u\n", goal);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+  gps --bench-sets [n]
+
+  Checks the SortedSet difference and union, both the scalar merge and
+  the vectorized one, against the original list versions on random
+  sets of every small size and of several larger sizes and densities,
+  then times all three. Returns nonzero if any answer disagrees.
+*/
+int run_set_bench(int argc, char **argv) {
+  std::size_t max_n = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 4096;
+  std::mt19937 rng(7);
+  bool ok = true;
+
+  auto random_set = [&](std::size_t n, Condition universe) {
+    std::uniform_int_distribution<Condition> pick(0, universe - 1);
+    std::vector<Condition> v;
+    for (std::size_t i = 0; i < n; ++i) {
+      v.push_back(pick(rng));
+    }
+    SortedSet s(v);
+    return std::vector<Condition>(std::begin(s), std::end(s));
+  };
+
+  auto ns_per_elt = [](std::size_t reps, std::size_t elts, std::function<void()> fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (std::size_t r = 0; r < reps; ++r) {
+      fn();
+    }
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    return std::chrono::duration<double, std::nano>(elapsed).count() / (reps * elts);
+  };
+
+  // Every pair of small sizes, empty included, so that each way a
+  // merge can end partway through a SIMD block gets checked.
+  for (std::size_t na = 0; na <= 3 * simd_width + 1; ++na) {
+    for (std::size_t nb = 0; nb <= 3 * simd_width + 1; ++nb) {
+      auto va = random_set(na, 64);
+      auto vb = random_set(nb, 64);
+      SortedSet a(va), b(vb), out, scratch;
+      set_diff(a, b, out);
+      ok = ok && out == SortedSet(set_diff(va, vb));
+      set_union_simd(a, b, out, scratch);
+      ok = ok && out == SortedSet(set_union(va, vb));
+    }
+  }
+
+  std::printf("%s merge, %zu-wide\n", have_simd_sets ? "vectorized" : "scalar (no SIMD)", simd_width);
+  std::printf("%8s %6s %12s %12s %12s %12s %12s %12s\n", "n", "dens",
+              "diff-list", "diff-scalar", "diff-simd", "union-list", "union-scalar", "union-simd");
+
+  for (std::size_t n = 16; n <= max_n; n *= 4) {
+    for (Condition density : {2u, 8u}) {
+      auto va = random_set(n, static_cast<Condition>(n * density));
+      auto vb = random_set(n, static_cast<Condition>(n * density));
+      SortedSet a(va), b(vb), out, scratch;
+
+      SortedSet want_diff(set_diff(va, vb));
+      SortedSet want_union(set_union(va, vb));
+      set_diff_scalar(a, b, out);
+      ok = ok && out == want_diff;
+      set_diff(a, b, out);
+      ok = ok && out == want_diff;
+      set_union_scalar(a, b, out);
+      ok = ok && out == want_union;
+      set_union_simd(a, b, out, scratch);
+      ok = ok && out == want_union;
+
+      std::size_t elts = va.size() + vb.size();
+      std::size_t reps = std::max<std::size_t>(1, (1u << 22) / (elts * std::max<std::size_t>(1, n / 16)));
+      volatile std::size_t sink = 0;
+      double d_list = ns_per_elt(reps, elts, [&] { sink += set_diff(va, vb).size(); });
+      double d_scalar = ns_per_elt(reps * 16, elts, [&] { set_diff_scalar(a, b, out); sink += out.size(); });
+      double d_simd = ns_per_elt(reps * 16, elts, [&] { set_diff(a, b, out); sink += out.size(); });
+      double u_list = ns_per_elt(reps, elts, [&] { sink += set_union(va, vb).size(); });
+      double u_scalar = ns_per_elt(reps * 16, elts, [&] { set_union_scalar(a, b, out); sink += out.size(); });
+      double u_simd = ns_per_elt(reps * 16, elts, [&] { set_union_simd(a, b, out, scratch); sink += out.size(); });
+      std::printf("%8zu %6u %12.3f %12.3f %12.3f %12.3f %12.3f %12.3f\n", n, density,
+                  d_list, d_scalar, d_simd, u_list, u_scalar, u_simd);
+    }
+  }
+
+  std::printf(ok ? "all results agree\n" : "MISMATCH\n");
+  return ok ? 0 : 1;
+}
+
+/*
+  Counting allocations
+  --------------------
+
+  The benchmarks report how many times the global allocator was
+  called per operation. Replacing the global operator new lets us
+  count: every new expression, and every allocation a standard
+  container makes, comes through here. The count is per thread, so
+  it costs an increment of a thread-local variable and solves running
+  on other threads don't disturb it.
+
+  Even an increment is too much to charge every allocation of every
+  run for, so like the search statistics the counter is only built
+  in with -DGPS_COUNT_ALLOCS, and the modes that need it say so
+  otherwise. Without it allocation_count is a constant 0.
+*/
+#ifdef GPS_COUNT_ALLOCS
+constexpr bool allocs_counted = true;
+thread_local std::uint64_t allocation_count = 0;
+
+// Kept out of line so the compiler doesn't pair an inlined malloc
+// with a free it can't see.
+__attribute__((noinline)) void* operator new(std::size_t size) {
+  ++allocation_count;
+  if (void* p = std::malloc(size == 0 ? 1 : size)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept {
+  std::free(p);
+}
+#else
+constexpr bool allocs_counted = false;
+constexpr std::uint64_t allocation_count = 0;
+#endif
+
+bool allocs_available(const char* mode) {
+  if (!allocs_counted) {
+    std::fprintf(stderr, "%s needs a build with -DGPS_COUNT_ALLOCS\n", mode);
+  }
+  return allocs_counted;
+}
+
+/*
+  The benchmark harness
+  ---------------------
+
+  gps --bench [--quick] runs a fixed set of benchmarks and writes the
+  results to stdout as JSON, one benchmark per line:
+
+    {"name": "find_all/template", "ns_per_op": 5.7, "allocs_per_op": 1,
+     "ops_per_sec": 1.7e+08}
+
+  For the solve/ benchmarks an op is one whole solve, so ops_per_sec
+  is solves per second, and for the heuristic/ ones it's one evaluation
+  of a relaxation heuristic. The Solver keeps its transposition table
+  between solves, so a problem solved again would mostly replay
+  sub-plans from it. The achieve/ and solve/ benchmarks clear the table
+  before every solve, so they time the search; the ones that use the
+  table say so with "transpositions": "cold". Everything is built from fixed seeds, so two
+  runs measure the same work. gps --bench-compare BASE NEW compares
+  two such files.
+*/
+struct BenchResult {
+  std::string name;
+  double ns_per_op = 0;
+  double allocs_per_op = 0;
+  double ops_per_sec = 0;
+  const char* transpositions = nullptr;  // "cold" if every solve starts with an empty table
+};
+
+/*
+  Run body until at least min_seconds have gone by, after one warm-up
+  call. Each call of body does ops_per_call operations.
+*/
+template<typename Body>
+BenchResult measure(const std::string& name, double min_seconds, std::size_t ops_per_call, Body body) {
+  body();
+  std::uint64_t calls = 0;
+  std::uint64_t allocs_before = allocation_count;
+  auto start = std::chrono::steady_clock::now();
+  std::chrono::duration<double> elapsed{0};
+  do {
+    for (int i = 0; i < 16; ++i) {
+      body();
+    }
+    calls += 16;
+    elapsed = std::chrono::steady_clock::now() - start;
+  } while (elapsed.count() < min_seconds);
+  std::uint64_t allocs = allocation_count - allocs_before;
+
+  double ops = static_cast<double>(calls) * ops_per_call;
+  BenchResult r;
+  r.name = name;
+  r.ns_per_op = elapsed.count() * 1e9 / ops;
+  r.allocs_per_op = allocs / ops;
+  r.ops_per_sec = ops / elapsed.count();
+  return r;
+}
+
+/*
+  Generate a domain in memory, by writing it to a temporary file and
+  loading it back the same way a domain file would be.
+*/
+std::unique_ptr<Domain> generated_domain(const GeneratorOptions& options, std::vector<Problem>& problems) {
+  std::FILE* tmp = std::tmpfile();
+  if (tmp == nullptr) {
+    std::fprintf(stderr, "can't create a temporary file\n");
+    return nullptr;
+  }
+  std::string text;
+  bool ok = generate_domain(options, tmp);
+  std::rewind(tmp);
+  ok = ok && read_all(tmp, text);
+  std::fclose(tmp);
+  if (!ok) {
+    return nullptr;
+  }
+  return parse_domain(text.data(), text.data() + text.size(), options.kind.c_str(), problems);
+}
+
+/*
+  Time what GPS does to its state when it executes an operator, and
+  when a failed branch takes operators back: Solver::apply_effects is
+  State::apply with the trail, and undo_candidate is State::undo back
+  to a mark. Each call applies every op of each plan in turn, starting
+  from that plan's state, then undoes them all, so every op changes
+  the state it's applied to. An op is one op applied and undone.
+*/
+BenchResult measure_apply(const std::string& name, double min_seconds, const Domain& domain,
+                          std::vector<State>& states, const std::vector<std::vector<OpId>>& plans) {
+  std::vector<Condition> trail;
+  std::size_t n_ops = 0;
+  for (const auto& plan : plans) {
+    n_ops += plan.size();
+  }
+  volatile std::uint64_t sink = 0;
+  return measure(name, min_seconds, std::max<std::size_t>(n_ops, 1), [&] {
+    for (std::size_t i = 0; i < plans.size(); ++i) {
+      for (auto op : plans[i]) {
+        states[i].apply(domain.dels(op), domain.adds(op), trail);
+      }
+      sink += states[i].hash();
+      states[i].undo(trail, 0);
+    }
+  });
+}
+
+std::vector<BenchResult> run_benchmarks(const Domain& school, double min_seconds) {
+  std::vector<BenchResult> results;
+  volatile std::size_t sink = 0;
+
+  // find_all over a random operator table, both predicate styles.
+  {
+    std::mt19937 rng(42);
+    const std::size_t n_ops = 20000;
+    std::uniform_int_distribution<Condition> any(0, n_ops / 4);
+    std::vector<Op> ops;
+    for (std::size_t i = 0; i < n_ops; ++i) {
+      ops.emplace_back("op", std::vector<Condition>{any(rng)},
+                       std::vector<Condition>{any(rng), any(rng)}, std::vector<Condition>{});
+    }
+    Condition goal = any(rng);
+    std::function<bool(Condition, const Op&)> erased = appropriate_p;
+    results.push_back(measure("find_all/std-function", min_seconds, n_ops, [&] {
+      sink += find_all(goal, ops, erased).size();
+    }));
+    results.push_back(measure("find_all/template", min_seconds, n_ops, [&] {
+      sink += find_all(goal, ops, [](Condition g, const Op& op) { return appropriate_p(g, op); }).size();
+    }));
+  }
+
+  // set_diff and set_union on 1024-element sets, as lists and as SortedSets.
+  {
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<Condition> any(0, 4096);
+    std::vector<Condition> a, b;
+    for (int i = 0; i < 1024; ++i) {
+      a.push_back(any(rng));
+      b.push_back(any(rng));
+    }
+    SortedSet sa(a), sb(b), out;
+    std::vector<Condition> la(std::begin(sa), std::end(sa)), lb(std::begin(sb), std::end(sb));
+    std::size_t n = la.size() + lb.size();
+    results.push_back(measure("set_diff/list", min_seconds, n, [&] { sink += set_diff(la, lb).size(); }));
+    results.push_back(measure("set_diff/sorted", min_seconds, n, [&] {
+      set_diff(sa, sb, out);
+      sink += out.size();
+    }));
+    results.push_back(measure("set_union/list", min_seconds, n, [&] { sink += set_union(la, lb).size(); }));
+    results.push_back(measure("set_union/sorted", min_seconds, n, [&] {
+      set_union(sa, sb, out);
+      sink += out.size();
+    }));
+  }
+
+  /*
+    achieve and apply_op on the school domain. achieve is private to
+    the Solver, so these go through GPS with a single goal: one that
+    already holds, one that needs a single operator, and the full
+    first problem in the file. apply_op/school applies that
+    problem's plan the way GPS does; see measure_apply.
+  */
+  {
+    auto id = [&](const char* name) {
+      Condition c = 0;
+      school.lookup(name, c);
+      return c;
+    };
+    Solver solver(school);
+    std::vector<Condition> full{id("son-at-home"), id("car-needs-battery"), id("have-money"), id("have-phone-book")};
+    std::vector<Condition> book{id("have-phone-book")};
+    std::vector<Condition> holds{id("son-at-home")};
+    std::vector<Condition> one_op{id("know-phone-number")};
+    std::vector<Condition> school_goal{id("son-at-school")};
+    results.push_back(measure("achieve/goal-holds", min_seconds, 1, [&] {
+      solver.clear_transpositions();
+      sink += solver.GPS(full, holds);
+    }));
+    results.push_back(measure("achieve/one-op", min_seconds, 1, [&] {
+      solver.clear_transpositions();
+      sink += solver.GPS(book, one_op);
+    }));
+    results.push_back(measure("achieve/school", min_seconds, 1, [&] {
+      solver.clear_transpositions();
+      sink += solver.GPS(full, school_goal);
+    }));
+    for (auto it = results.end() - 3; it != results.end(); ++it) {
+      it->transpositions = "cold";
+    }
+
+    solver.GPS(full, school_goal);
+    std::vector<State> states{ school.make_state(full) };
+    results.push_back(measure_apply("apply_op/school", min_seconds, school, states, { solver.plan() }));
+  }
+
+  /*
+    Whole solves on generated domains; an op is one solve. The best-
+    first engines only get the domains they can solve quickly with the
+    goal-count heuristic; blocks-6 is there because GPS can't do it.
+  */
+  struct Workload {
+    const char* name;
+    GeneratorOptions options;
+    SolveOptions solve;
+  };
+  auto options = [](const char* kind, std::size_t size, std::size_t conditions, std::size_t ops,
+                    std::size_t depth) {
+    GeneratorOptions o;
+    o.kind = kind;
+    o.seed = 2014;
+    o.size = size;
+    o.conditions = conditions;
+    o.ops = ops;
+    o.depth = depth;
+    o.problems = 20;
+    return o;
+  };
+  auto engine = [](Engine e, bool track_applicable, bool relevant_only) {
+    SolveOptions s;
+    s.engine = e;
+    s.track_applicable = track_applicable;
+    s.relevant_only = relevant_only;
+    return s;
+  };
+  GeneratorOptions mazes = options("mazes", 8, 0, 0, 0);
+  mazes.count = 10;
+  std::vector<Workload> workloads{
+    { "solve/blocks-4", options("blocks", 4, 0, 0, 0), engine(Engine::gps, false, true) },
+    { "solve/monkey-50", options("monkey", 50, 0, 0, 0), engine(Engine::gps, false, true) },
+    { "solve/maze-30", options("maze", 30, 0, 0, 0), engine(Engine::gps, false, true) },
+    { "solve/layered-8", options("layered", 0, 2000, 10000, 8), engine(Engine::gps, false, true) },
+    { "solve/random-10k", options("random", 0, 2000, 10000, 0), engine(Engine::gps, false, true) },
+    { "solve/random-10k/iterative", options("random", 0, 2000, 10000, 0), engine(Engine::gps_iterative, false, true) },
+    { "solve/random-10k/tracked", options("random", 0, 2000, 10000, 0), engine(Engine::gps, true, true) },
+    { "solve/blocks-4/astar", options("blocks", 4, 0, 0, 0), engine(Engine::astar, false, true) },
+    { "solve/blocks-4/astar/tracked", options("blocks", 4, 0, 0, 0), engine(Engine::astar, true, true) },
+    { "solve/blocks-4/gbfs", options("blocks", 4, 0, 0, 0), engine(Engine::gbfs, false, true) },
+    { "solve/blocks-6/gbfs", options("blocks", 6, 0, 0, 0), engine(Engine::gbfs, false, true) },
+    { "solve/maze-30/gbfs", options("maze", 30, 0, 0, 0), engine(Engine::gbfs, false, true) },
+    { "solve/mazes-10/astar", mazes, engine(Engine::astar, false, true) },
+    { "solve/mazes-10/astar/all-ops", mazes, engine(Engine::astar, false, false) },
+  };
+  for (const auto& w : workloads) {
+    std::vector<Problem> problems;
+    auto domain = generated_domain(w.options, problems);
+    if (!domain || problems.empty()) {
+      continue;
+    }
+    Solver solver(*domain);
+    results.push_back(measure(w.name, min_seconds, problems.size(), [&] {
+      for (const auto& p : problems) {
+        solver.clear_transpositions();
+        sink += solver.solve(p.initial, p.goals, w.solve);
+      }
+    }));
+    if (w.solve.engine == Engine::gps || w.solve.engine == Engine::gps_iterative) {
+      results.back().transpositions = "cold";
+    }
+  }
+
+  // The same apply path, on the plans GPS finds in a bigger domain.
+  {
+    std::vector<Problem> problems;
+    auto domain = generated_domain(options("layered", 0, 2000, 10000, 8), problems);
+    if (domain && !problems.empty()) {
+      Solver solver(*domain);
+      std::vector<State> states;
+      std::vector<std::vector<OpId>> plans;
+      for (const auto& p : problems) {
+        solver.GPS(p.initial, p.goals);
+        states.push_back(domain->make_state(p.initial));
+        plans.push_back(solver.plan());
+      }
+      results.push_back(measure_apply("apply_op/layered-8", min_seconds, *domain, states, plans));
+    }
+  }
+
+  /*
+    One evaluation of each relaxation heuristic from the initial state
+    of every problem in a generated domain; an op is one evaluation.
+  */
+  {
+    std::vector<Problem> problems;
+    auto domain = generated_domain(options("layered", 0, 2000, 10000, 8), problems);
+    if (domain && !problems.empty()) {
+      RelaxationHeuristic relaxation(*domain);
+      std::vector<State> initial;
+      for (const auto& p : problems) {
+        initial.push_back(domain->make_state(p.initial));
+      }
+      const std::pair<const char*, Heuristic> kinds[] = {
+        { "heuristic/max", Heuristic::max },
+        { "heuristic/add", Heuristic::add },
+        { "heuristic/ff", Heuristic::ff },
+      };
+      for (const auto& kind : kinds) {
+        results.push_back(measure(kind.first, min_seconds, problems.size(), [&] {
+          for (std::size_t i = 0; i < problems.size(); ++i) {
+            sink += relaxation.evaluate(initial[i], problems[i].goals, kind.second);
+          }
+        }));
+      }
+    }
+  }
+
+  /*
+    Finding the applicable ops in a state, by testing every op and with
+    the Domain's SuccessorGenerator. The states are the initial state
+    of each problem and the state GPS leaves behind when it solves it,
+    which has many more conditions true; an op is one state.
+  */
+  {
+    const std::pair<const char*, GeneratorOptions> kinds[] = {
+      { "successors/random-10k", options("random", 0, 2000, 10000, 0) },
+      { "successors/layered-8", options("layered", 0, 2000, 10000, 8) },
+    };
+    for (const auto& kind : kinds) {
+      std::vector<Problem> problems;
+      auto domain = generated_domain(kind.second, problems);
+      if (!domain || problems.empty()) {
+        continue;
+      }
+      std::vector<State> states;
+      Solver solver(*domain);
+      for (const auto& p : problems) {
+        states.push_back(domain->make_state(p.initial));
+        solver.GPS(p.initial, p.goals);
+        states.push_back(solver.state());
+      }
+      std::vector<OpId> applicable;
+      std::vector<std::uint32_t> stack;
+      std::string name = kind.first;
+      results.push_back(measure(name + "/linear", min_seconds, states.size(), [&] {
+        for (const auto& state : states) {
+          applicable.clear();
+          for (OpId op = 0; op < domain->n_ops(); ++op) {
+            auto preconds = domain->preconds(op);
+            if (std::all_of(std::begin(preconds), std::end(preconds),
+                            [&](Condition c) { return state.test(c); })) {
+              applicable.push_back(op);
+            }
+          }
+          sink += applicable.size();
+        }
+      }));
+      results.push_back(measure(name + "/tree", min_seconds, states.size(), [&] {
+        for (const auto& state : states) {
+          domain->successors().applicable(state, applicable, stack);
+          sink += applicable.size();
+        }
+      }));
+    }
+  }
+  return results;
+}
+
+void write_json(std::FILE* out, const std::vector<BenchResult>& results) {
+  std::fprintf(out, "[\n");
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    std::fprintf(out, "{\"name\": \"%s\", \"ns_per_op\": %.4f, \"allocs_per_op\": %.4f, \"ops_per_sec\": %.6g",
+                 r.name.c_str(), r.ns_per_op, r.allocs_per_op, r.ops_per_sec);
+    if (r.transpositions != nullptr) {
+      std::fprintf(out, ", \"transpositions\": \"%s\"", r.transpositions);
+    }
+    std::fprintf(out, "}%s\n", i + 1 < results.size() ? "," : "");
+  }
+  std::fprintf(out, "]\n");
+}
+
+/*
+  Read back a file written by write_json. This isn't a general JSON
+  parser; it knows that every benchmark is on a line of its own.
+*/
+bool read_bench_json(const char* path, std::vector<BenchResult>& results) {
+  std::string text;
+  if (!read_file(path, text)) {
+    return false;
+  }
+  std::size_t pos = 0;
+  while ((pos = text.find("{\"name\": \"", pos)) != std::string::npos) {
+    BenchResult r;
+    std::size_t name_start = pos + 10;
+    std::size_t name_end = text.find('"', name_start);
+    if (name_end == std::string::npos) {
+      break;
+    }
+    r.name = text.substr(name_start, name_end - name_start);
+    if (std::sscanf(text.c_str() + name_end, "\", \"ns_per_op\": %lf, \"allocs_per_op\": %lf, \"ops_per_sec\": %lf",
+                    &r.ns_per_op, &r.allocs_per_op, &r.ops_per_sec) != 3) {
+      std::fprintf(stderr, "%s: can't read benchmark '%s'\n", path, r.name.c_str());
+      return false;
+    }
+    results.push_back(r);
+    pos = name_end;
+  }
+  return true;
+}
+
+/*
+  gps --bench [--quick]
+
+  --quick runs every benchmark for a tenth of the usual time; good for
+  checking that the harness works, not for comparing numbers. The
+  achieve/ benchmarks use the built-in school domain.
+*/
+int run_bench(int argc, char **argv) {
+  if (!allocs_available("--bench")) {
+    return 2;
+  }
+  double min_seconds = 0.2;
+  for (int i = 2; i < argc; ++i) {
+    if (std::string(argv[i]) == "--quick") {
+      min_seconds = 0.02;
+    } else {
+      std::fprintf(stderr, "unknown argument '%s'\n", argv[i]);
+      return 2;
+    }
+  }
+  auto school = school_domain();
+  if (!school) {
+    return 1;
+  }
+  write_json(stdout, run_benchmarks(*school, min_seconds));
+  return 0;
+}
+
+/*
+  gps --bench-compare BASE NEW [--threshold FRACTION]
+
+  Lines up the benchmarks in two --bench outputs by name and flags a
+  regression wherever NEW is slower than BASE by more than the
+  threshold (default 0.10, that is 10%), or allocates more per op.
+  Exits with 1 if anything regressed, so it can gate a build.
+*/
+int run_bench_compare(int argc, char **argv) {
+  if (argc < 4) {
+    std::fprintf(stderr, "usage: gps --bench-compare BASE NEW [--threshold FRACTION]\n");
+    return 2;
+  }
+  double threshold = 0.10;
+  for (int i = 4; i < argc; ++i) {
+    if (std::string(argv[i]) == "--threshold" && i + 1 < argc) {
+      threshold = std::strtod(argv[++i], nullptr);
+    } else {
+      std::fprintf(stderr, "unknown argument '%s'\n", argv[i]);
+      return 2;
+    }
+  }
+  std::vector<BenchResult> base, now;
+  if (!read_bench_json(argv[2], base) || !read_bench_json(argv[3], now)) {
+    return 2;
+  }
+
+  bool regressed = false;
+  std::printf("%-24s %12s %12s %8s %10s %10s\n", "benchmark", "base ns/op", "new ns/op", "change",
+              "base alloc", "new alloc");
+  for (const auto& n : now) {
+    auto b = std::find_if(std::begin(base), std::end(base),
+                          [&](const BenchResult& r) { return r.name == n.name; });
+    if (b == std::end(base)) {
+      std::printf("%-24s %12s %12.2f %8s %10s %10.2f  new\n", n.name.c_str(), "-", n.ns_per_op, "-", "-",
+                  n.allocs_per_op);
+      continue;
+    }
+    double change = b->ns_per_op > 0 ? n.ns_per_op / b->ns_per_op - 1 : 0;
+    bool slower = change > threshold;
+    bool more_allocs = n.allocs_per_op > b->allocs_per_op + 1e-9;
+    regressed = regressed || slower || more_allocs;
+    std::printf("%-24s %12.2f %12.2f %+7.1f%% %10.2f %10.2f%s\n", n.name.c_str(), b->ns_per_op, n.ns_per_op,
+                100 * change, b->allocs_per_op, n.allocs_per_op,
+                slower ? "  REGRESSION" : more_allocs ? "  MORE ALLOCATIONS" : "");
+  }
+  for (const auto& b : base) {
+    if (std::none_of(std::begin(now), std::end(now), [&](const BenchResult& r) { return r.name == b.name; })) {
+      std::printf("%-24s %12.2f %12s %8s  missing\n", b.name.c_str(), b.ns_per_op, "-", "-");
+    }
+  }
+  return regressed ? 1 : 0;
+}
+
+/*
+  gps --check-allocs
+
+  Checks that solving doesn't allocate once a Solver is warm. Every
+  engine, with each heuristic the best-first ones can use, with and
+  without the applicability tracker, and forward search with all ops
+  as well as only the relevant ones, solves the problems of a few
+  generated domains twice on the same Solver. The first pass grows
+  the Solver's buffers to what those problems need. In between, the
+  transposition table is cleared, so that the second pass searches
+  everything the first one did instead of replaying what it found,
+  and that second pass must not call the global allocator at all.
+  Prints one line per combination and exits with 1 if any of them
+  allocated.
+*/
+int run_check_allocs() {
+  if (!allocs_available("--check-allocs")) {
+    return 2;
+  }
+  struct Check {
+    const char* engine;
+    const char* heuristic;
+    bool track_applicable;
+    bool relevant_only;
+  };
+  const Check checks[] = {
+    { "gps", "ff", false, true }, { "gps-iterative", "ff", false, true },
+    { "astar", "blind", false, true }, { "astar", "max", false, true },
+    { "gbfs", "goal-count", false, true }, { "gbfs", "add", false, true }, { "gbfs", "ff", false, true },
+    { "gps", "ff", true, true }, { "gps-iterative", "ff", true, true },
+    { "astar", "blind", true, true }, { "gbfs", "ff", true, true },
+    { "astar", "blind", false, false }, { "gbfs", "goal-count", false, false },
+    { "astar", "max", true, false },
+  };
+  const char* kinds[] = { "blocks", "monkey", "maze", "mazes" };
+  bool ok = true;
+  for (const char* kind : kinds) {
+    GeneratorOptions generate;
+    generate.kind = kind;
+    generate.seed = 2014;
+    generate.size = 4;
+    std::vector<Problem> problems;
+    auto domain = generated_domain(generate, problems);
+    if (!domain) {
+      return 1;
+    }
+    for (const auto& check : checks) {
+      SolveOptions options;
+      parse_engine(check.engine, options.engine);
+      parse_heuristic(check.heuristic, options.heuristic);
+      options.track_applicable = check.track_applicable;
+      options.relevant_only = check.relevant_only;
+      Solver solver(*domain);
+      for (const auto& p : problems) {
+        solver.solve(p.initial, p.goals, options);
+      }
+      solver.clear_transpositions();
+      std::uint64_t before = allocation_count;
+      for (const auto& p : problems) {
+        solver.solve(p.initial, p.goals, options);
+      }
+      std::uint64_t allocs = allocation_count - before;
+      std::printf("%-8s %-14s %-11s %-8s %-8s %llu allocations%s\n", kind, check.engine, check.heuristic,
+                  check.track_applicable ? "tracked" : "", check.relevant_only ? "" : "all-ops",
+                  static_cast<unsigned long long>(allocs), allocs == 0 ? "" : "  FAILED");
+      ok = ok && allocs == 0;
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+/*
+  gps --check-batch
+
+  Checks that solve_batch gives the same answers however many threads
+  it uses. Each engine solves the problems of a few generated domains
+  once on one thread and once on four, and every problem must come
+  back with the same verdict and the same plan both times, whichever
+  worker's Solver ended up with it. Prints one line per combination
+  and exits with 1 on any mismatch.
+*/
+int run_check_batch() {
+  const char* engines[] = { "gps", "gps-iterative", "astar", "gbfs" };
+  GeneratorOptions small;
+  small.seed = 2014;
+  small.size = 4;
+  small.conditions = 200;
+  small.ops = 600;
+  small.depth = 5;
+  small.problems = 40;
+  const char* kinds[] = { "blocks", "monkey", "maze", "layered", "random" };
+  bool ok = true;
+  for (const char* kind : kinds) {
+    GeneratorOptions generate = small;
+    generate.kind = kind;
+    std::vector<Problem> problems;
+    auto domain = generated_domain(generate, problems);
+    if (!domain) {
+      return 1;
+    }
+    for (const char* engine : engines) {
+      SolveOptions options;
+      parse_engine(engine, options.engine);
+      auto serial = solve_batch(*domain, problems, 1, options);
+      auto parallel = solve_batch(*domain, problems, 4, options);
+      std::size_t solved = 0, mismatches = 0;
+      for (std::size_t i = 0; i < problems.size(); ++i) {
+        solved += serial[i].solved;
+        mismatches += serial[i].solved != parallel[i].solved || serial[i].plan != parallel[i].plan;
+      }
+      std::printf("%-8s %-14s %2zu/%zu solved, %zu mismatches%s\n", kind, engine, solved, problems.size(),
+                  mismatches, mismatches == 0 ? "" : "  FAILED");
+      ok = ok && mismatches == 0;
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+/*
+  gps --check-undo
+
+  Checks that the trail takes failed branches back exactly. A failed
+  candidate that left anything behind would leave the state out of
+  step with the plan, so for every problem of a few generated domains
+  with goal cycles and delete lists, GPS's final state must be what
+  replaying its plan from the initial state gives, and its hash must
+  be the hash of that state built from scratch. (Each op's
+  preconditions needn't all hold when it's replayed: achieving one
+  can clobber another, which is the PAIP GPS's bug, not the trail's.)
+  Then a random run of ops is applied through the trail and undone,
+  which must give back the same state and hash. The ops undone count
+  is GPS's own, so it needs -DGPS_STATS. Exits with 1 if anything
+  differs.
+*/
+int run_check_undo() {
+  GeneratorOptions small;
+  small.seed = 2014;
+  small.del_density = 0.3;
+  small.problems = 40;
+  GeneratorOptions layered = small;
+  layered.kind = "layered";
+  layered.conditions = 60;
+  layered.ops = 120;
+  layered.depth = 4;
+  layered.branching = 2;
+  layered.cycles = 0.2;
+  GeneratorOptions random = small;
+  random.kind = "random";
+  random.conditions = 300;
+  random.ops = 1500;
+  GeneratorOptions blocks = small;
+  blocks.kind = "blocks";
+  blocks.size = 4;
+  const GeneratorOptions domains[] = { layered, random, blocks };
+
+  std::mt19937 rng(17);
+  bool ok = true;
+  for (const auto& generate : domains) {
+    std::vector<Problem> problems;
+    auto domain = generated_domain(generate, problems);
+    if (!domain) {
+      return 1;
+    }
+    std::uniform_int_distribution<OpId> any_op(0, static_cast<OpId>(domain->n_ops() - 1));
+    const char* engines[] = { "gps", "gps-iterative" };
+    for (const char* engine : engines) {
+      SolveOptions options;
+      parse_engine(engine, options.engine);
+      Solver solver(*domain);
+      std::size_t solved = 0, undone = 0, mismatches = 0;
+      std::vector<Condition> trail;
+      for (const auto& p : problems) {
+        solved += solver.solve(p.initial, p.goals, options);
+        undone += solver.stats().ops_undone;
+        State replayed = domain->make_state(p.initial);
+        for (auto op : solver.plan()) {
+          replayed.apply(domain->dels(op), domain->adds(op));
+        }
+        State rebuilt = domain->make_state();
+        rebuilt.assign_words(solver.state().words());
+        bool same = replayed == solver.state() && rebuilt.hash() == solver.state().hash();
+
+        State state = solver.state();
+        trail.clear();
+        for (int k = 0; k < 20; ++k) {
+          OpId op = any_op(rng);
+          state.apply(domain->dels(op), domain->adds(op), trail);
+        }
+        state.undo(trail, 0);
+        same = same && state == solver.state() && state.hash() == solver.state().hash();
+        mismatches += !same;
+      }
+      std::printf("%-8s %-14s %2zu/%zu solved, %4zu ops undone, %zu mismatches%s\n", generate.kind.c_str(),
+                  engine, solved, problems.size(), undone, mismatches, mismatches == 0 ? "" : "  FAILED");
+      ok = ok && mismatches == 0;
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+/*
+  gps --check-snapshot
+
+  Checks that a Domain saved as a snapshot and mapped back is the
+  Domain that was saved. For a few generated domains, every section
+  is compared through the accessors: names and their lookup, actions,
+  the precondition, add and delete lists, the goal and consumer
+  indexes, the Zobrist keys, and the ops the successor generator
+  finds in each problem's initial state, which must also be the ops
+  whose preconditions hold there. Then every engine solves the
+  domain's problems against both, and must find the same plans.
+  Exits with 1 if anything differs.
+*/
+int run_check_snapshot() {
+  GeneratorOptions small;
+  small.seed = 2014;
+  small.size = 4;
+  small.conditions = 200;
+  small.ops = 600;
+  small.depth = 5;
+  small.problems = 20;
+  const char* kinds[] = { "blocks", "monkey", "mazes", "layered", "random" };
+  auto same = [](Span<std::uint32_t> a, Span<std::uint32_t> b) {
+    return a.size() == b.size() && std::equal(std::begin(a), std::end(a), std::begin(b));
+  };
+  bool ok = true;
+  for (const char* kind : kinds) {
+    GeneratorOptions generate = small;
+    generate.kind = kind;
+    std::vector<Problem> problems;
+    auto built = generated_domain(generate, problems);
+    if (!built) {
+      return 1;
+    }
+    char path[] = "/tmp/gps-snapshot-XXXXXX";
+    int fd = ::mkstemp(path);
+    if (fd < 0) {
+      std::fprintf(stderr, "can't create a temporary file\n");
+      return 1;
+    }
+    ::close(fd);
+    std::unique_ptr<Domain> mapped;
+    if (built->save(path)) {
+      mapped = Domain::map(path);
+    }
+    ::unlink(path);  // the mapping outlives the name
+    if (!mapped) {
+      return 1;
+    }
+
+    const Domain& a = *built;
+    const Domain& b = *mapped;
+    std::size_t differences = 0;
+    differences += a.n_conditions() != b.n_conditions() || a.n_ops() != b.n_ops();
+    for (Condition c = 0; differences == 0 && c < a.n_conditions(); ++c) {
+      Condition found = ~Condition{0};
+      differences += std::strcmp(a.name(c), b.name(c)) != 0 || !b.lookup(a.name(c), found) || found != c;
+      differences += !same(a.candidates(c), b.candidates(c)) || !same(a.consumers(c), b.consumers(c));
+      differences += a.zobrist_key(c) != b.zobrist_key(c);
+    }
+    for (OpId op = 0; differences == 0 && op < a.n_ops(); ++op) {
+      differences += std::strcmp(a.action(op), b.action(op)) != 0;
+      differences += !same(a.preconds(op), b.preconds(op)) || !same(a.adds(op), b.adds(op)) ||
+                     !same(a.dels(op), b.dels(op));
+    }
+    std::vector<OpId> from_a, from_b, linear;
+    std::vector<std::uint32_t> stack;
+    for (const auto& p : problems) {
+      State sa = a.make_state(p.initial), sb = b.make_state(p.initial);
+      differences += sa.hash() != sb.hash();
+      a.successors().applicable(sa, from_a, stack);
+      b.successors().applicable(sb, from_b, stack);
+      linear.clear();
+      for (OpId op = 0; op < a.n_ops(); ++op) {
+        auto preconds = a.preconds(op);
+        if (std::all_of(std::begin(preconds), std::end(preconds), [&sa](Condition c) { return sa.test(c); })) {
+          linear.push_back(op);
+        }
+      }
+      std::sort(std::begin(from_a), std::end(from_a));
+      std::sort(std::begin(from_b), std::end(from_b));
+      differences += from_a != linear || from_b != linear;
+    }
+    const char* engines[] = { "gps", "gps-iterative", "astar", "gbfs" };
+    for (const char* engine : engines) {
+      SolveOptions options;
+      parse_engine(engine, options.engine);
+      auto from_built = solve_batch(a, problems, 1, options);
+      auto from_mapped = solve_batch(b, problems, 1, options);
+      for (std::size_t i = 0; i < problems.size(); ++i) {
+        differences += from_built[i].solved != from_mapped[i].solved || from_built[i].plan != from_mapped[i].plan;
+      }
+    }
+    std::printf("%-8s %5zu conditions, %5zu ops, %zu differences%s\n", kind, a.n_conditions(), a.n_ops(),
+                differences, differences == 0 ? "" : "  FAILED");
+    ok = ok && differences == 0;
+  }
+  return ok ? 0 : 1;
+}
+
+/*
+  gps --check-transpositions
+
+  Checks that the transposition table only answers for the position
+  an entry was stored for. Entries are stored under one key for
+  several different positions of a generated domain, as if every key
+  collided, and each lookup must find exactly the entry for its own
+  goal, state and goal stack. A stored sub-plan is recorded against
+  the state before it was applied, worked out from the trail, so it
+  must be found from that state and not from the one it left behind.
+  Exits with 1 if any lookup gives the wrong answer.
+*/
+int run_check_transpositions() {
+  GeneratorOptions generate;
+  generate.kind = "blocks";
+  generate.seed = 2014;
+  generate.size = 4;
+  generate.problems = 8;
+  std::vector<Problem> problems;
+  auto domain = generated_domain(generate, problems);
+  if (!domain) {
+    return 1;
+  }
+  const std::uint64_t key = 42;
+  TranspositionTable table(domain->make_state().n_words());
+  State empty_stack = domain->make_state();
+  std::size_t wrong = 0;
+  for (std::size_t i = 0; i < problems.size(); ++i) {
+    const auto& p = problems[i];
+    State state = domain->make_state(p.initial);
+    State stack = domain->make_state();
+    stack.set(p.goals[0]);
+    Condition goal = p.goals.back();
+    table.store_failure(key, goal, state, stack, 10);
+    wrong += table.find(key, goal, state, stack) == nullptr;
+    wrong += table.find(key, goal, state, empty_stack) != nullptr;
+    wrong += i > 0 && table.find(key, goal, domain->make_state(problems[i - 1].initial), stack) != nullptr;
+
+    // Apply a plan of up to three ops through a trail and store it.
+    std::vector<Condition> trail;
+    std::vector<OpId> plan;
+    State after = state;
+    for (OpId op = 0; op < domain->n_ops() && plan.size() < 3; ++op) {
+      auto preconds = domain->preconds(op);
+      if (std::all_of(std::begin(preconds), std::end(preconds), [&after](Condition c) { return after.test(c); })) {
+        after.apply(domain->dels(op), domain->adds(op), trail);
+        plan.push_back(op);
+      }
+    }
+    table.store_plan(key, goal, after, empty_stack, { trail.data(), trail.data() + trail.size() },
+                     plan.data(), plan.data() + plan.size(), 10);
+    const TranspositionTable::Entry* found = table.find(key, goal, state, empty_stack);
+    wrong += found == nullptr || found->length != plan.size() ||
+             !std::equal(std::begin(plan), std::end(plan), std::begin(table.plan(*found)));
+    wrong += !trail.empty() && table.find(key, goal, after, empty_stack) != nullptr;
+  }
+  std::printf("%zu wrong answers%s\n", wrong, wrong == 0 ? "" : "  FAILED");
+  return wrong == 0 ? 0 : 1;
+}
+
+/*
+  gps --check-cycles
+
+  Checks that a goal GPS is already pursuing fails at once instead of
+  being pursued again. In the domain below a needs b and b needs a,
+  so without the goal stack achieving either one recurses until the
+  stack overflows. With it, gps and gps-iterative must both fail on
+  every problem, and with -DGPS_STATS never have more than the two
+  goals open at once. Exits with 1 otherwise.
+*/
+int run_check_cycles() {
+  const char text[] = R"(op get-a
+pre b
+add a
+
+op get-b
+pre a
+add b
+
+init
+goal a
+
+init
+goal b
+
+init
+goal a b
+)";
+  std::vector<Problem> problems;
+  auto domain = parse_domain(text, text + sizeof text - 1, "<cycles>", problems);
+  if (!domain) {
+    return 1;
+  }
+  const char* engines[] = { "gps", "gps-iterative" };
+  bool ok = true;
+  for (const char* engine : engines) {
+    SolveOptions options;
+    parse_engine(engine, options.engine);
+    Solver solver(*domain);
+    for (std::size_t i = 0; i < problems.size(); ++i) {
+      // Otherwise the later problems would just find the first one's failure.
+      solver.clear_transpositions();
+      bool solved = solver.solve(problems[i].initial, problems[i].goals, options);
+      std::uint64_t depth = solver.stats().max_depth;
+      bool right = !solved && (!stats_enabled || depth <= 2);
+      std::printf("%-14s problem %zu  %s, max depth %llu%s\n", engine, i, solved ? "SOLVED" : "FAILED",
+                  static_cast<unsigned long long>(depth), right ? "" : "  FAILED");
+      ok = ok && right;
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+/*
+  gps --check-iterative
+
+  Checks that gps-iterative does exactly what gps does. Both solve the
+  problems of a range of generated domains, on Solvers of their own,
+  and must give the same verdict, the same plan and the same final
+  state for every problem. With -DGPS_STATS they must also have made
+  the same number of achieve calls, tried the same candidates and
+  applied and undone the same ops. Exits with 1 on any difference.
+*/
+int run_check_iterative() {
+  struct Workload {
+    const char* kind;
+    std::size_t size;
+    std::size_t conditions;
+    std::size_t ops;
+    std::size_t depth;
+    double cycles;
+  };
+  const Workload workloads[] = {
+    { "blocks", 4, 0, 0, 0, 0.0 },
+    { "blocks", 5, 0, 0, 0, 0.0 },
+    { "monkey", 100, 0, 0, 0, 0.0 },
+    { "maze", 12, 0, 0, 0, 0.0 },
+    { "mazes", 5, 0, 0, 0, 0.0 },
+    { "layered", 0, 60, 120, 4, 0.2 },
+    { "layered", 0, 400, 2000, 8, 0.0 },
+    { "random", 0, 300, 1500, 0, 0.0 },
+  };
+  bool ok = true;
+  for (const auto& w : workloads) {
+    GeneratorOptions generate;
+    generate.kind = w.kind;
+    generate.seed = 2014;
+    generate.size = w.size;
+    generate.conditions = w.conditions;
+    generate.ops = w.ops;
+    generate.depth = w.depth;
+    generate.branching = 2;
+    generate.del_density = 0.3;
+    generate.cycles = w.cycles;
+    generate.count = 5;
+    generate.problems = 30;
+    std::vector<Problem> problems;
+    auto domain = generated_domain(generate, problems);
+    if (!domain) {
+      return 1;
+    }
+    SolveOptions recursive, iterative;
+    recursive.engine = Engine::gps;
+    iterative.engine = Engine::gps_iterative;
+    Solver a(*domain), b(*domain);
+    std::size_t solved = 0, differences = 0;
+    for (const auto& p : problems) {
+      bool solved_a = a.solve(p.initial, p.goals, recursive);
+      bool solved_b = b.solve(p.initial, p.goals, iterative);
+      const SearchStats& x = a.stats();
+      const SearchStats& y = b.stats();
+      solved += solved_a;
+      differences += solved_a != solved_b || a.plan() != b.plan() || a.state() != b.state() ||
+                     x.achieve_calls != y.achieve_calls || x.candidates != y.candidates ||
+                     x.ops_applied != y.ops_applied || x.ops_undone != y.ops_undone;
+    }
+    std::printf("%-8s %4zu ops %2zu/%zu solved, %zu differences%s\n", w.kind, domain->n_ops(), solved,
+                problems.size(), differences, differences == 0 ? "" : "  FAILED");
+    ok = ok && differences == 0;
+  }
+  return ok ? 0 : 1;
+}
+
+/*
+  gps --check-tracked
+
+  Checks that track_applicable changes how a plan is found and never
+  which one. Every engine solves the problems of a few generated
+  domains with and without the tracker, and must give the same
+  verdict, plan and final state for every problem. Exits with 1 on
+  any difference.
+*/
+int run_check_tracked() {
+  GeneratorOptions small;
+  small.seed = 2014;
+  small.size = 4;
+  small.conditions = 200;
+  small.ops = 600;
+  small.depth = 5;
+  small.del_density = 0.3;
+  small.problems = 30;
+  const char* kinds[] = { "blocks", "monkey", "maze", "mazes", "layered", "random" };
+  const char* engines[] = { "gps", "gps-iterative", "astar", "gbfs" };
+  bool ok = true;
+  for (const char* kind : kinds) {
+    GeneratorOptions generate = small;
+    generate.kind = kind;
+    std::vector<Problem> problems;
+    auto domain = generated_domain(generate, problems);
+    if (!domain) {
+      return 1;
+    }
+    for (const char* engine : engines) {
+      SolveOptions plain, tracked;
+      parse_engine(engine, plain.engine);
+      tracked.engine = plain.engine;
+      tracked.track_applicable = true;
+      Solver a(*domain), b(*domain);
+      std::size_t solved = 0, differences = 0;
+      for (const auto& p : problems) {
+        bool solved_a = a.solve(p.initial, p.goals, plain);
+        bool solved_b = b.solve(p.initial, p.goals, tracked);
+        solved += solved_a;
+        differences += solved_a != solved_b || a.plan() != b.plan() || a.state() != b.state();
+      }
+      std::printf("%-8s %-14s %2zu/%zu solved, %zu differences%s\n", kind, engine, solved, problems.size(),
+                  differences, differences == 0 ? "" : "  FAILED");
+      ok = ok && differences == 0;
+    }
+  }
+  return ok ? 0 : 1;
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && std::string(argv[1]) == "--generate") {
+    return run_generate(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--compile") {
+    return run_compile(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--batch") {
+    return run_batch(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--bench") {
+    return run_bench(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--bench-compare") {
+    return run_bench_compare(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--check-allocs") {
+    return run_check_allocs();
+  }
+  if (argc > 1 && std::string(argv[1]) == "--check-batch") {
+    return run_check_batch();
+  }
+  if (argc > 1 && std::string(argv[1]) == "--check-undo") {
+    return run_check_undo();
+  }
+  if (argc > 1 && std::string(argv[1]) == "--check-transpositions") {
+    return run_check_transpositions();
+  }
+  if (argc > 1 && std::string(argv[1]) == "--check-cycles") {
+    return run_check_cycles();
+  }
+  if (argc > 1 && std::string(argv[1]) == "--check-iterative") {
+    return run_check_iterative();
+  }
+  if (argc > 1 && std::string(argv[1]) == "--check-tracked") {
+    return run_check_tracked();
+  }
+  if (argc > 1 && std::string(argv[1]) == "--check-snapshot") {
+    return run_check_snapshot();
+  }
+  if (argc > 1 && std::string(argv[1]) == "--bench-find-all") {
+    return run_find_all_bench(argc, argv);
+  }
+  if (argc > 1 && std::string(argv[1]) == "--bench-sets") {
+    return run_set_bench(argc, argv);
+  }
+
+  /*
+    Otherwise, gps [--domain FILE] [--stats] solves every problem in
+    FILE in turn, printing each plan. Without FILE it's the built-in
+    school domain from the start of chapter 4, and its four problems
+    are the four initial states the Lisp version has you try one at
+    a time.
+  */
+  const char* domain_path = nullptr;
+  bool want_stats = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--domain" && i + 1 < argc) {
+      domain_path = argv[++i];
+    } else if (arg == "--stats") {
+      if (!stats_available()) {
+        return 2;
+      }
+      want_stats = true;
+    } else {
+      std::fprintf(stderr, "unknown argument '%s'\n", arg.c_str());
+      return 2;
+    }
+  }
+
+  std::vector<Problem> problems;
+  std::unique_ptr<Domain> domain;
+  if (domain_path != nullptr) {
+    domain = load_domain(domain_path, problems);
+  } else {
+    domain = school_domain();
+    if (domain && !parse_problems(school_problems, school_problems + sizeof school_problems - 1, "<school>",
+                                  *domain, problems)) {
+      return 1;
+    }
+  }
+  if (!domain) {
+    return 1;
+  }
+  if (problems.empty()) {
+    std::fprintf(stderr, "%s: no problems to solve\n", domain_path != nullptr ? domain_path : "<school>");
+    return 1;
+  }
+
+  // here's how complement works, even though we don't end up using it above.
+  std::function<bool(int)> even_p = [](int n) { return (n % 2 == 0); };
+  std::function<bool(int)> odd_p = complement(even_p);
+  std::printf("2 is even: %d\n", !odd_p(2));
+
+  Solver solver(*domain);
+  for (const auto& problem : problems) {
+    bool solved = solver.GPS(problem.initial, problem.goals);
+    print_plan(*domain, solver.plan());
+    std::printf(solved ? "SOLVED.\n" : "FAILED.\n");
+
+    if (want_stats) {
+      write_json(stderr, solver.stats());
+    }
+  }
 
   return 0;
 }